@@ -0,0 +1,126 @@
+#include "balance.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+bool balance_rowgroups(
+    uint32_t *owners,
+    uint32_t rowgroups,
+    const double *times,
+    uint32_t num_procs,
+    double tolerance
+) {
+    uint32_t counts[num_procs];
+    for (uint32_t p = 0; p < num_procs; p++) {
+        counts[p] = 0;
+    }
+    for (uint32_t g = 0; g < rowgroups; g++) {
+        counts[owners[g]]++;
+    }
+
+    uint32_t participants = 0;
+    double total_time = 0.0;
+    double max_time = 0.0;
+    for (uint32_t p = 0; p < num_procs; p++) {
+        if (counts[p] == 0) {
+            continue;
+        }
+        participants++;
+        total_time += times[p];
+        if (times[p] > max_time) {
+            max_time = times[p];
+        }
+    }
+
+    if (participants < 2 || total_time <= 0.0) {
+        return false;
+    }
+
+    if (max_time <= (total_time / participants) * (1.0 + tolerance)) {
+        return false;
+    }
+
+    // Give each process a share of the rowgroups in proportion to its speed,
+    // rowgroups per second, rounding by largest remainder.
+    double speeds[num_procs];
+    double total_speed = 0.0;
+    for (uint32_t p = 0; p < num_procs; p++) {
+        speeds[p] = 0.0;
+        if (counts[p] > 0) {
+            speeds[p] = counts[p] / fmax(times[p], 1e-9);
+            total_speed += speeds[p];
+        }
+    }
+
+    uint32_t targets[num_procs];
+    double remainders[num_procs];
+    uint32_t assigned = 0;
+    for (uint32_t p = 0; p < num_procs; p++) {
+        targets[p] = 0;
+        remainders[p] = -1.0;
+        if (counts[p] == 0) {
+            continue;
+        }
+
+        double share = rowgroups * speeds[p] / total_speed;
+        targets[p] = (uint32_t)share;
+        remainders[p] = share - targets[p];
+        if (targets[p] == 0) {
+            targets[p] = 1;
+            remainders[p] = -1.0;
+        }
+        assigned += targets[p];
+    }
+
+    while (assigned < rowgroups) {
+        uint32_t best = 0;
+        for (uint32_t p = 1; p < num_procs; p++) {
+            if (remainders[p] > remainders[best]) {
+                best = p;
+            }
+        }
+        targets[best]++;
+        remainders[best] = -1.0;
+        assigned++;
+    }
+
+    // Raising the slowest to one rowgroup may have handed out too many, take
+    // them back from whoever has the most.
+    while (assigned > rowgroups) {
+        uint32_t most = 0;
+        for (uint32_t p = 1; p < num_procs; p++) {
+            if (targets[p] > targets[most]) {
+                most = p;
+            }
+        }
+        targets[most]--;
+        assigned--;
+    }
+
+    // Processes over their target give up their last rowgroups, which go to
+    // the processes under theirs.
+    const uint32_t none = num_procs;
+    bool changed = false;
+    for (uint32_t g = rowgroups; g-- > 0;) {
+        uint32_t p = owners[g];
+        if (counts[p] > targets[p]) {
+            counts[p]--;
+            owners[g] = none;
+        }
+    }
+
+    uint32_t p = 0;
+    for (uint32_t g = 0; g < rowgroups; g++) {
+        if (owners[g] != none) {
+            continue;
+        }
+        while (counts[p] >= targets[p]) {
+            p++;
+        }
+        owners[g] = p;
+        counts[p]++;
+        changed = true;
+    }
+
+    return changed;
+}
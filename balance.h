@@ -0,0 +1,24 @@
+#ifndef _BALANCE_H_
+#define _BALANCE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Decide whether rowgroups should move between processes, given how long each
+// process spent computing over the same number of iterations.
+//
+// owners maps each rowgroup to a process id and is updated in place. times is
+// indexed by process id; processes that own no rowgroups are ignored and are
+// not given any. Nothing moves unless the slowest process took more than
+// tolerance (e.g. 0.1 for 10%) longer than the average. Every process keeps at
+// least one rowgroup, and as few rowgroups move as possible.
+//
+// Returns true if any rowgroup changed owner.
+bool balance_rowgroups(
+    uint32_t *owners,
+    uint32_t rowgroups,
+    const double *times,
+    uint32_t num_procs,
+    double tolerance);
+
+#endif
@@ -0,0 +1,657 @@
+// clock_gettime is POSIX, not C11.
+#define _POSIX_C_SOURCE 200809L
+
+#include <argp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "grid.h"
+#include "kernel.h"
+#include "row.h"
+#include "stream.h"
+#include "tiled.h"
+#include "wire.h"
+
+// Microbenchmarks of the building blocks of a run. Every kernel is checked
+// against a plain reference step first, then each case is timed over a few
+// warmup and measured repetitions. A case's throughput is taken from its
+// fastest repetition, which varies least from run to run on a busy machine.
+// With a baseline it is compared to the one recorded, and the run fails if it
+// has dropped by more than the tolerance.
+
+static const char* KERNEL_NAMES[] = {"scalar", "sse2", "avx2", "avx512"};
+static const uint32_t KERNEL_NAMES_LEN = 4;
+
+// Enough iterations for blues and reds to start piling up against each other.
+static const uint32_t CHECK_STEPS = 8;
+
+static const uint64_t BENCH_SEED = 42;
+
+#define LIST_MAX 16
+
+// name, key, arg name, falgs, doc, group
+static struct argp_option options[] = {
+    {"gridsize",  'n', "sizes",     0, "Comma separated grid sizes."},
+    {"tilesize",  't', "tiles",     0, "Comma separated numbers of tiles a side."},
+    {"kernel",    'k', "kernel",    0, "Only time this kernel."},
+    {"filter",    'f', "text",      0, "Only time cases whose name contains text."},
+    {"warmup",    'w', "reps",      0, "Untimed repetitions of each case."},
+    {"reps",      'r', "reps",      0, "Timed repetitions of each case."},
+    {"baseline",  'b', "file",      0, "Compare against a baseline."},
+    {"save",      's', "file",      0, "Save the results as a baseline."},
+    {"tolerance", 'T', "percent",   0, "Slowdown tolerated against the baseline."},
+    {0}
+};
+
+struct list_t {
+    uint32_t values[LIST_MAX];
+    uint32_t len;
+};
+
+struct arguments {
+    struct list_t sizes;
+    struct list_t tiles;
+    const char* kernel;
+    const char* filter;
+    uint32_t warmup;
+    uint32_t reps;
+    const char* baseline;
+    const char* save;
+    double tolerance;
+};
+
+static bool list_parse(struct list_t *self, const char *text) {
+    self->len = 0;
+    const char *at = text;
+    while (*at != '\0') {
+        char *end;
+        unsigned long value = strtoul(at, &end, 10);
+        if (end == at || value == 0 || self->len == LIST_MAX) {
+            return false;
+        }
+        self->values[self->len++] = value;
+        at = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return false;
+        }
+    }
+    return self->len > 0;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    struct arguments *args = state->input;
+    switch (key) {
+        case 'n':
+            if (!list_parse(&args->sizes, arg)) {
+                argp_error(state, "Invalid grid sizes '%s'", arg);
+            }
+            break;
+        case 't':
+            if (!list_parse(&args->tiles, arg)) {
+                argp_error(state, "Invalid tile counts '%s'", arg);
+            }
+            break;
+        case 'k': args->kernel = arg; break;
+        case 'f': args->filter = arg; break;
+        case 'w': args->warmup = atoi(arg); break;
+        case 'r': args->reps = atoi(arg); break;
+        case 'b': args->baseline = arg; break;
+        case 's': args->save = arg; break;
+        case 'T': args->tolerance = atof(arg); break;
+    }
+    return 0;
+}
+
+static struct argp argp = {options, parse_opt, "", "", 0, 0, 0};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Reference implementation of one iteration, a cell at a time into a second
+// grid, as the model is defined.
+static void reference_step(struct grid_t *self, struct grid_t *tmp) {
+    uint32_t n = self->size;
+
+    grid_copy(tmp, self);
+    for (uint32_t r = 0; r < n; r++) {
+        for (uint32_t c = 0; c < n; c++) {
+            uint32_t right = (c + 1) % n;
+            if (self->elements[r][c] == RED && self->elements[r][right] == WHITE) {
+                tmp->elements[r][c] = WHITE;
+                tmp->elements[r][right] = RED;
+            }
+        }
+    }
+
+    grid_copy(self, tmp);
+    for (uint32_t r = 0; r < n; r++) {
+        uint32_t below = (r + 1) % n;
+        for (uint32_t c = 0; c < n; c++) {
+            if (tmp->elements[r][c] == BLUE && tmp->elements[below][c] == WHITE) {
+                self->elements[r][c] = WHITE;
+                self->elements[below][c] = BLUE;
+            }
+        }
+    }
+}
+
+static bool grid_equal(const struct grid_t *a, const struct grid_t *b) {
+    for (uint32_t r = 0; r < a->size; r++) {
+        if (memcmp(a->elements[r], b->elements[r],
+                a->size * sizeof(enum cell_type)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check the current kernel against the reference on a grid of size n, with
+// tiles a side for the tiled and stream layouts. Prints what failed.
+static bool check_kernel(uint32_t n, const struct list_t *tiles) {
+    struct grid_t expect, tmp, got;
+    grid_alloc(&expect, n);
+    grid_alloc(&tmp, n);
+    grid_alloc(&got, n);
+    grid_fill_random(&expect, 0.33, 0.33, BENCH_SEED);
+    grid_copy(&got, &expect);
+
+    bool ok = true;
+
+    // Counts, and packing every row and its reverse through each format.
+    enum cell_type* back = malloc(n * sizeof(enum cell_type));
+    uint8_t* encoded = malloc(wire_max_size(WIRE_RAW, n));
+    uint8_t* sent = calloc(1, wire_packed_size(n));
+    uint8_t* received = calloc(1, wire_packed_size(n));
+    for (uint32_t r = 0; r < n && ok; r++) {
+        const enum cell_type* row = expect.elements[r];
+        uint64_t blue = 0, red = 0, want_blue = 0, want_red = 0;
+        kernel->count(row, n, &blue, &red);
+        for (uint32_t c = 0; c < n; c++) {
+            want_blue += row[c] == BLUE;
+            want_red += row[c] == RED;
+        }
+        if (blue != want_blue || red != want_red) {
+            fprintf(stderr, "FAIL %s: count of row %u\n", kernel->name, r);
+            ok = false;
+        }
+
+        for (enum wire_format f = WIRE_RAW; f <= WIRE_DELTA && ok; f++) {
+            wire_encode(f, row, n, sent, encoded);
+            wire_decode(f, encoded, n, received, back);
+            if (memcmp(back, row, n * sizeof(enum cell_type)) != 0) {
+                fprintf(stderr, "FAIL %s: wire format %d of row %u\n",
+                    kernel->name, f, r);
+                ok = false;
+            }
+        }
+    }
+    free(back);
+    free(encoded);
+    free(sent);
+    free(received);
+
+    for (uint32_t i = 0; i < CHECK_STEPS && ok; i++) {
+        reference_step(&expect, &tmp);
+        grid_step(&got);
+        if (!grid_equal(&expect, &got)) {
+            fprintf(stderr, "FAIL %s: grid_step n=%u at iteration %u\n",
+                kernel->name, n, i + 1);
+            ok = false;
+        }
+    }
+
+    for (uint32_t t = 0; t < tiles->len && ok; t++) {
+        if (n % tiles->values[t] != 0) {
+            continue;
+        }
+        grid_fill_random(&expect, 0.33, 0.33, BENCH_SEED);
+        struct tiled_grid_t tiled;
+        tiled_init(&tiled, n, n / tiles->values[t]);
+        tiled_from_grid(&tiled, &expect);
+
+        for (uint32_t i = 0; i < CHECK_STEPS && ok; i++) {
+            reference_step(&expect, &tmp);
+            tiled_step(&tiled);
+            tiled_to_grid(&tiled, &got);
+            if (!grid_equal(&expect, &got)) {
+                fprintf(stderr, "FAIL %s: tiled_step n=%u tiles=%u at iteration %u\n",
+                    kernel->name, n, tiles->values[t], i + 1);
+                ok = false;
+            }
+        }
+        tiled_free(&tiled);
+    }
+
+    // The stream layout carries rows over from one band to the next, so try
+    // bands of one and two rows, an odd band that leaves a short one at the
+    // end, and the whole grid in one.
+    uint32_t odd = 3;
+    while (odd < n && n % odd == 0) {
+        odd += 2;
+    }
+    uint32_t bands[] = {1, 2, odd < n ? odd : 1, n};
+    uint32_t tile_size = n;
+    for (uint32_t t = 0; t < tiles->len; t++) {
+        if (n % tiles->values[t] == 0) {
+            tile_size = n / tiles->values[t];
+            break;
+        }
+    }
+
+    for (uint32_t b = 0; b < 4 && ok; b++) {
+        grid_fill_random(&expect, 0.33, 0.33, BENCH_SEED);
+        struct stream_grid_t stream;
+        if (!stream_init(&stream, NULL, n, tile_size, bands[b])) {
+            perror("FAIL: could not create a file for the stream layout");
+            ok = false;
+            break;
+        }
+        stream_from_grid(&stream, &expect);
+
+        for (uint32_t i = 0; i < CHECK_STEPS && ok; i++) {
+            struct tile_t want, tile;
+            reference_step(&expect, &tmp);
+            grid_max_tile(&expect, tile_size, &want);
+            stream_step(&stream, &tile);
+            stream_to_grid(&stream, &got);
+            if (!grid_equal(&expect, &got)
+                    || tile.tx != want.tx || tile.ty != want.ty
+                    || tile.color != want.color || tile.ratio != want.ratio) {
+                fprintf(stderr, "FAIL %s: stream_step n=%u band=%u at iteration %u\n",
+                    kernel->name, n, bands[b], i + 1);
+                ok = false;
+            }
+        }
+        stream_free(&stream);
+    }
+
+    grid_free(&expect);
+    grid_free(&tmp);
+    grid_free(&got);
+    return ok;
+}
+
+// A baseline file has a line per case, its name and its cells per second.
+struct baseline_t {
+    char** names;
+    double* rates;
+    uint32_t len;
+};
+
+static bool baseline_load(struct baseline_t *self, const char *path) {
+    self->names = NULL;
+    self->rates = NULL;
+    self->len = 0;
+
+    FILE* in = fopen(path, "r");
+    if (in == NULL) {
+        return false;
+    }
+
+    char name[256];
+    double rate;
+    while (fscanf(in, "%255s %lf", name, &rate) == 2) {
+        self->names = realloc(self->names, (self->len + 1) * sizeof(char*));
+        self->rates = realloc(self->rates, (self->len + 1) * sizeof(double));
+        self->names[self->len] = strdup(name);
+        self->rates[self->len] = rate;
+        self->len++;
+    }
+    fclose(in);
+    return true;
+}
+
+// The recorded rate of a case, or 0 if it was not recorded.
+static double baseline_find(const struct baseline_t *self, const char *name) {
+    for (uint32_t i = 0; i < self->len; i++) {
+        if (strcmp(self->names[i], name) == 0) {
+            return self->rates[i];
+        }
+    }
+    return 0.0;
+}
+
+static void baseline_free(struct baseline_t *self) {
+    for (uint32_t i = 0; i < self->len; i++) {
+        free(self->names[i]);
+    }
+    free(self->names);
+    free(self->rates);
+}
+
+// What every case shares: the grids it works on, the options, and where the
+// results go.
+struct bench_t {
+    struct arguments args;
+    struct baseline_t baseline;
+    FILE* save;
+    double* times;
+    uint32_t regressions;
+
+    // The starting grid, and a copy to work on that is reset before each
+    // repetition.
+    struct grid_t start;
+    struct grid_t work;
+    uint32_t tile_size;
+    struct tiled_grid_t tiled;
+    enum wire_format wire;
+};
+
+typedef void (*bench_fn)(struct bench_t *self);
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Time fn over cells cells, after reset has set up each repetition untimed.
+static void bench_run(
+    struct bench_t *self,
+    const char *name,
+    uint64_t cells,
+    bench_fn reset,
+    bench_fn fn
+) {
+    if (self->args.filter != NULL && strstr(name, self->args.filter) == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < self->args.warmup + self->args.reps; i++) {
+        if (reset != NULL) {
+            reset(self);
+        }
+        double start = now();
+        fn(self);
+        double elapsed = now() - start;
+        if (i >= self->args.warmup) {
+            self->times[i - self->args.warmup] = elapsed;
+        }
+    }
+
+    qsort(self->times, self->args.reps, sizeof(double), compare_doubles);
+    double median = self->times[self->args.reps / 2];
+    double rate = cells / self->times[0];
+
+    printf("%-40s %10.3f %10.3f %10.1f", name,
+        self->times[0] * 1e3, median * 1e3, rate * 1e-6);
+
+    double before = baseline_find(&self->baseline, name);
+    if (before > 0.0) {
+        double change = (rate / before - 1.0) * 100.0;
+        bool regressed = change < -self->args.tolerance;
+        printf(" %10.1f %+7.1f%%%s", before * 1e-6, change,
+            regressed ? "  REGRESSION" : "");
+        self->regressions += regressed;
+    }
+    printf("\n");
+
+    if (self->save != NULL) {
+        fprintf(self->save, "%s %.0f\n", name, rate);
+    }
+}
+
+static void reset_work(struct bench_t *self) {
+    grid_copy(&self->work, &self->start);
+}
+
+static void reset_tiled(struct bench_t *self) {
+    tiled_from_grid(&self->tiled, &self->start);
+}
+
+static void bench_grid_init(struct bench_t *self) {
+    struct grid_t grid;
+    grid_init(&grid, self->start.size);
+    grid_free(&grid);
+}
+
+static void bench_grid_fill(struct bench_t *self) {
+    grid_fill_random(&self->work, 0.33, 0.33, BENCH_SEED);
+}
+
+static void bench_grid_copy(struct bench_t *self) {
+    grid_copy(&self->work, &self->start);
+}
+
+// Above any tile of a random grid, so every tile is counted.
+static void bench_grid_check_tiles(struct bench_t *self) {
+    grid_check_tiles(&self->start, self->tile_size, 99);
+}
+
+static void bench_grid_max_tile(struct bench_t *self) {
+    struct tile_t tile;
+    grid_max_tile(&self->start, self->tile_size, &tile);
+}
+
+static void bench_serialize(struct bench_t *self) {
+    struct grid_row_t row, copy;
+    row.len = self->start.size;
+    for (uint32_t r = 0; r < self->start.size; r++) {
+        row.id = r;
+        row.cells = self->start.elements[r];
+        void* buf = grid_row_serialize(&row);
+        grid_row_unserialize(&copy, buf);
+        free(copy.cells);
+        free(buf);
+    }
+}
+
+static void bench_wire(struct bench_t *self) {
+    uint32_t n = self->start.size;
+    uint8_t* buf = malloc(wire_max_size(self->wire, n));
+    uint8_t* sent = calloc(1, wire_packed_size(n));
+    uint8_t* received = calloc(1, wire_packed_size(n));
+    for (uint32_t r = 0; r < n; r++) {
+        wire_encode(self->wire, self->start.elements[r], n, sent, buf);
+        wire_decode(self->wire, buf, n, received, self->work.elements[r]);
+    }
+    free(buf);
+    free(sent);
+    free(received);
+}
+
+static void bench_red(struct bench_t *self) {
+    for (uint32_t r = 0; r < self->work.size; r++) {
+        enum cell_type* row = self->work.elements[r];
+        kernel->red(row, row, self->work.size, row[self->work.size-1], row[0]);
+    }
+}
+
+// The blue sweep of grid_step, without the care it takes over the last row.
+static void bench_blue(struct bench_t *self) {
+    uint32_t n = self->work.size;
+    enum cell_type* moved = self->work.boundary;
+    kernel->blue_moved(self->work.elements[n-1], self->work.elements[0], moved, n);
+    for (uint32_t r = 0; r + 1 < n; r++) {
+        kernel->blue(self->work.elements[r], self->work.elements[r+1], moved, n);
+    }
+}
+
+static void bench_count(struct bench_t *self) {
+    uint64_t blue = 0, red = 0;
+    for (uint32_t r = 0; r < self->start.size; r++) {
+        kernel->count(self->start.elements[r], self->start.size, &blue, &red);
+    }
+}
+
+static void bench_grid_step(struct bench_t *self) {
+    grid_step(&self->work);
+}
+
+static void bench_tiled_step(struct bench_t *self) {
+    tiled_step(&self->tiled);
+}
+
+// The cases that do not depend on the kernel.
+static void bench_common(struct bench_t *self) {
+    uint32_t n = self->start.size;
+    uint64_t cells = (uint64_t)n * n;
+    char name[128];
+
+    snprintf(name, sizeof(name), "grid_init/n=%u", n);
+    bench_run(self, name, cells, NULL, bench_grid_init);
+    snprintf(name, sizeof(name), "grid_fill_random/n=%u", n);
+    bench_run(self, name, cells, NULL, bench_grid_fill);
+    snprintf(name, sizeof(name), "grid_copy/n=%u", n);
+    bench_run(self, name, cells, NULL, bench_grid_copy);
+    snprintf(name, sizeof(name), "grid_row_serialize/n=%u", n);
+    bench_run(self, name, cells, NULL, bench_serialize);
+
+    for (uint32_t t = 0; t < self->args.tiles.len; t++) {
+        uint32_t tiles = self->args.tiles.values[t];
+        if (n % tiles != 0) {
+            continue;
+        }
+        self->tile_size = n / tiles;
+        snprintf(name, sizeof(name), "grid_check_tiles/n=%u/t=%u", n, tiles);
+        bench_run(self, name, cells, NULL, bench_grid_check_tiles);
+    }
+}
+
+// The cases that run through the current kernel.
+static void bench_kernel(struct bench_t *self) {
+    uint32_t n = self->start.size;
+    uint64_t cells = (uint64_t)n * n;
+    const char* k = kernel->name;
+    char name[128];
+
+    snprintf(name, sizeof(name), "red/%s/n=%u", k, n);
+    bench_run(self, name, cells, reset_work, bench_red);
+    snprintf(name, sizeof(name), "blue/%s/n=%u", k, n);
+    bench_run(self, name, cells, reset_work, bench_blue);
+    snprintf(name, sizeof(name), "grid_step/%s/n=%u", k, n);
+    bench_run(self, name, cells, reset_work, bench_grid_step);
+    snprintf(name, sizeof(name), "count/%s/n=%u", k, n);
+    bench_run(self, name, cells, NULL, bench_count);
+
+    const char* wires[] = {"packed", "delta"};
+    for (uint32_t w = 0; w < 2; w++) {
+        self->wire = w == 0 ? WIRE_PACKED : WIRE_DELTA;
+        snprintf(name, sizeof(name), "wire_%s/%s/n=%u", wires[w], k, n);
+        bench_run(self, name, cells, NULL, bench_wire);
+    }
+
+    for (uint32_t t = 0; t < self->args.tiles.len; t++) {
+        uint32_t tiles = self->args.tiles.values[t];
+        if (n % tiles != 0) {
+            continue;
+        }
+        self->tile_size = n / tiles;
+
+        snprintf(name, sizeof(name), "grid_max_tile/%s/n=%u/t=%u", k, n, tiles);
+        bench_run(self, name, cells, NULL, bench_grid_max_tile);
+
+        tiled_init(&self->tiled, n, self->tile_size);
+        snprintf(name, sizeof(name), "tiled_step/%s/n=%u/t=%u", k, n, tiles);
+        bench_run(self, name, cells, reset_tiled, bench_tiled_step);
+        tiled_free(&self->tiled);
+    }
+}
+
+int main(int argc, char **argv) {
+    struct arguments args;
+    list_parse(&args.sizes, "256,1024,2048");
+    list_parse(&args.tiles, "4,32");
+    args.kernel = NULL;
+    args.filter = NULL;
+    args.warmup = 2;
+    args.reps = 9;
+    args.baseline = NULL;
+    args.save = NULL;
+    args.tolerance = 10.0;
+    argp_parse(&argp, argc, argv, 0, 0, &args);
+
+    if (args.reps == 0) {
+        fprintf(stderr, "Error: need at least one repetition\n");
+        return 1;
+    }
+
+    struct bench_t bench;
+    bench.args = args;
+    bench.regressions = 0;
+    bench.times = malloc(args.reps * sizeof(double));
+
+    bench.baseline.len = 0;
+    bench.baseline.names = NULL;
+    bench.baseline.rates = NULL;
+    if (args.baseline != NULL && !baseline_load(&bench.baseline, args.baseline)) {
+        fprintf(stderr, "Error: cannot read baseline %s\n", args.baseline);
+        return 1;
+    }
+
+    bench.save = NULL;
+    if (args.save != NULL) {
+        bench.save = fopen(args.save, "w");
+        if (bench.save == NULL) {
+            fprintf(stderr, "Error: cannot create %s\n", args.save);
+            return 1;
+        }
+    }
+
+    // The kernels to time, every one this CPU supports unless told otherwise.
+    const char* kernels[KERNEL_NAMES_LEN];
+    uint32_t kernels_len = 0;
+    for (uint32_t i = 0; i < KERNEL_NAMES_LEN; i++) {
+        if (args.kernel != NULL && strcmp(args.kernel, KERNEL_NAMES[i]) != 0) {
+            continue;
+        }
+        if (kernel_init(KERNEL_NAMES[i])) {
+            kernels[kernels_len++] = KERNEL_NAMES[i];
+        }
+    }
+    if (kernels_len == 0) {
+        fprintf(stderr, "Error: kernel is unknown or not supported by this CPU\n");
+        return 1;
+    }
+
+    bool ok = true;
+    for (uint32_t s = 0; s < args.sizes.len; s++) {
+        for (uint32_t k = 0; k < kernels_len; k++) {
+            kernel_init(kernels[k]);
+            ok = check_kernel(args.sizes.values[s], &args.tiles) && ok;
+        }
+    }
+    if (!ok) {
+        return 1;
+    }
+
+    printf("%-40s %10s %10s %10s %10s %8s\n",
+        "case", "min ms", "median ms", "Mcells/s", "baseline", "change");
+
+    for (uint32_t s = 0; s < args.sizes.len; s++) {
+        uint32_t n = args.sizes.values[s];
+        grid_alloc(&bench.start, n);
+        grid_alloc(&bench.work, n);
+        grid_fill_random(&bench.start, 0.33, 0.33, BENCH_SEED);
+
+        kernel_init(kernels[0]);
+        bench_common(&bench);
+        for (uint32_t k = 0; k < kernels_len; k++) {
+            kernel_init(kernels[k]);
+            bench_kernel(&bench);
+        }
+
+        grid_free(&bench.start);
+        grid_free(&bench.work);
+    }
+
+    if (bench.save != NULL) {
+        fclose(bench.save);
+    }
+    baseline_free(&bench.baseline);
+    free(bench.times);
+
+    if (bench.regressions > 0) {
+        fprintf(stderr, "%u cases regressed by more than %.1f%%\n",
+            bench.regressions, args.tolerance);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,499 @@
+// nanosleep is POSIX, not C11.
+#define _POSIX_C_SOURCE 200809L
+
+#include "ensemble.h"
+#include "stream.h"
+#include "tiled.h"
+
+#include <assert.h>
+#include <mpi.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const int MPI_ENSEMBLE_TAG = 2;
+
+// Parse a comma separated list of numbers or start:stop:step ranges into a
+// freshly allocated array.
+static bool parse_list(const char *str, size_t len, double **out, uint32_t *out_len) {
+    *out = NULL;
+    *out_len = 0;
+
+    const char *end = str + len;
+    while (str < end) {
+        char *cursor;
+        double start = strtod(str, &cursor);
+        if (cursor == str) {
+            return false;
+        }
+
+        double stop = start;
+        double step = 1.0;
+        if (cursor < end && *cursor == ':') {
+            str = cursor + 1;
+            stop = strtod(str, &cursor);
+            if (cursor == str || cursor >= end || *cursor != ':') {
+                return false;
+            }
+            str = cursor + 1;
+            step = strtod(str, &cursor);
+            if (cursor == str || step <= 0.0) {
+                return false;
+            }
+        }
+
+        // Allow for rounding in the step so that stop itself is included.
+        for (double v = start; v <= stop + step * 1e-9; v += step) {
+            *out = realloc(*out, (*out_len + 1) * sizeof(double));
+            (*out)[(*out_len)++] = v;
+        }
+
+        if (cursor < end && *cursor != ',') {
+            return false;
+        }
+        str = cursor + 1;
+    }
+
+    return *out_len > 0;
+}
+
+// Whether value is a whole number within [min, max], checked before it is
+// converted, which is undefined for doubles out of range.
+static bool parse_whole(double value, double min, double max, uint64_t *out) {
+    if (!(value >= min && value <= max)) {
+        return false;
+    }
+    *out = (uint64_t)value;
+    return (double)*out == value;
+}
+
+bool ensemble_parse(struct ensemble_t *self, const char *spec) {
+    self->base_seed = 1;
+    self->seeds = 1;
+    self->densities = NULL;
+    self->densities_len = 0;
+    self->thresholds.len = 0;
+
+    while (*spec) {
+        const char *field_end = strchr(spec, ';');
+        if (field_end == NULL) {
+            field_end = spec + strlen(spec);
+        }
+
+        const char *eq = memchr(spec, '=', field_end - spec);
+        if (eq == NULL) {
+            return false;
+        }
+
+        size_t key_len = eq - spec;
+        const char *value = eq + 1;
+        size_t value_len = field_end - value;
+
+        double *list;
+        uint32_t list_len;
+        if (!parse_list(value, value_len, &list, &list_len)) {
+            free(list);
+            return false;
+        }
+
+        if (key_len == 5 && strncmp(spec, "seeds", 5) == 0) {
+            uint64_t seeds;
+            bool valid = parse_whole(list[0], 1, UINT32_MAX, &seeds);
+            free(list);
+            if (!valid) {
+                return false;
+            }
+            self->seeds = (uint32_t)seeds;
+        } else if (key_len == 4 && strncmp(spec, "seed", 4) == 0) {
+            // The largest double below 2^64.
+            bool valid = parse_whole(
+                list[0], 0, 18446744073709549568.0, &self->base_seed);
+            free(list);
+            if (!valid) {
+                return false;
+            }
+        } else if (key_len == 7 && strncmp(spec, "density", 7) == 0) {
+            free(self->densities);
+            self->densities = list;
+            self->densities_len = list_len;
+        } else if (key_len == 9 && strncmp(spec, "threshold", 9) == 0) {
+            uint32_t values[list_len];
+            bool valid = true;
+            for (uint32_t i = 0; i < list_len && valid; i++) {
+                uint64_t value = 0;
+                valid = parse_whole(list[i], 1, UINT32_MAX, &value);
+                values[i] = (uint32_t)value;
+            }
+            free(list);
+            if (!valid || !thresholds_init(&self->thresholds, values, list_len)) {
+                return false;
+            }
+        } else {
+            free(list);
+            return false;
+        }
+
+        spec = *field_end ? field_end + 1 : field_end;
+    }
+
+    // Default to the classic board, 1/3 red and 1/3 blue.
+    if (self->densities_len == 0) {
+        self->densities = malloc(sizeof(double));
+        self->densities[0] = 1.0 / 3.0;
+        self->densities_len = 1;
+    }
+
+    for (uint32_t i = 0; i < self->densities_len; i++) {
+        if (self->densities[i] < 0.0 || self->densities[i] > 0.5) {
+            return false;
+        }
+    }
+
+    // Every member is numbered with a uint32_t.
+    uint64_t len = (uint64_t)self->seeds * self->densities_len * self->thresholds.len;
+    return self->thresholds.len > 0 && len <= UINT32_MAX;
+}
+
+void ensemble_free(struct ensemble_t *self) {
+    free(self->densities);
+    self->densities = NULL;
+}
+
+uint32_t ensemble_len(const struct ensemble_t *self) {
+    return ensemble_runs(self) * self->thresholds.len;
+}
+
+uint32_t ensemble_runs(const struct ensemble_t *self) {
+    return self->seeds * self->densities_len;
+}
+
+// Runs are numbered seed-major, then density. The members of a run follow one
+// another, one per threshold.
+static void ensemble_run_params(
+    const struct ensemble_t *self,
+    uint32_t run,
+    uint64_t *seed,
+    double *density
+) {
+    *seed = self->base_seed + run / self->densities_len;
+    *density = self->densities[run % self->densities_len];
+}
+
+struct chunk_t {
+    const struct ensemble_t *ensemble;
+    uint32_t grid_size;
+    uint32_t tile_size;
+    uint32_t max_iters;
+    enum grid_layout layout;
+    const char *scratch;
+    uint32_t band_rows;
+    uint32_t threads;
+
+    uint32_t start;
+    uint32_t len;
+    atomic_uint next;
+    struct member_result_t *results;
+    // Set once a chunk run by chunk_runner is done.
+    atomic_bool finished;
+};
+
+// Worker thread: claim runs of the chunk one at a time until none are left,
+// so that a slow run never holds up the others.
+static void* chunk_worker(void *arg) {
+    struct chunk_t *chunk = arg;
+
+    // A streamed grid never exists in memory as a whole.
+    struct grid_t grid;
+    if (chunk->layout != LAYOUT_STREAM) {
+        grid_alloc(&grid, chunk->grid_size);
+    }
+
+    struct tiled_grid_t tiled;
+    if (chunk->layout == LAYOUT_TILES) {
+        tiled_init(&tiled, chunk->grid_size, chunk->tile_size);
+    }
+
+    struct stream_grid_t stream;
+    if (chunk->layout == LAYOUT_STREAM) {
+        bool created = stream_init(
+            &stream, chunk->scratch, chunk->grid_size, chunk->tile_size,
+            chunk->band_rows);
+        if (!created) {
+            perror("Could not create a file for the stream layout");
+            exit(1);
+        }
+    }
+
+    uint32_t i;
+    while ((i = atomic_fetch_add(&chunk->next, 1)) < chunk->len) {
+        uint32_t run = chunk->start + i;
+        uint64_t seed;
+        double density;
+        ensemble_run_params(chunk->ensemble, run, &seed, &density);
+
+        if (chunk->layout == LAYOUT_STREAM) {
+            stream_fill_random(&stream, density, density, seed);
+        } else {
+            grid_fill_random(&grid, density, density, seed);
+        }
+        if (chunk->layout == LAYOUT_TILES) {
+            tiled_from_grid(&tiled, &grid);
+        }
+
+        struct thresholds_t thresholds = chunk->ensemble->thresholds;
+        thresholds_reset(&thresholds);
+
+        for (uint32_t it = 1; it <= chunk->max_iters; it++) {
+            struct tile_t tile;
+            if (chunk->layout == LAYOUT_STREAM) {
+                stream_step(&stream, &tile);
+            } else if (chunk->layout == LAYOUT_TILES) {
+                tiled_step(&tiled);
+                tiled_max_tile(&tiled, &tile);
+            } else {
+                grid_step(&grid);
+                grid_max_tile(&grid, chunk->tile_size, &tile);
+            }
+            if (thresholds_update(&thresholds, it, &tile)) {
+                break;
+            }
+        }
+
+        for (uint32_t t = 0; t < thresholds.len; t++) {
+            struct member_result_t *result =
+                &chunk->results[i * thresholds.len + t];
+            result->member = run * thresholds.len + t;
+            result->iterations = thresholds.iterations[t];
+            result->tile = thresholds.tiles[t];
+        }
+    }
+
+    if (chunk->layout == LAYOUT_STREAM) {
+        stream_free(&stream);
+    } else {
+        grid_free(&grid);
+    }
+    if (chunk->layout == LAYOUT_TILES) {
+        tiled_free(&tiled);
+    }
+    return NULL;
+}
+
+static void run_chunk(struct chunk_t *chunk, uint32_t threads) {
+    atomic_init(&chunk->next, 0);
+
+    pthread_t workers[threads];
+    for (uint32_t t = 1; t < threads; t++) {
+        pthread_create(&workers[t], NULL, chunk_worker, chunk);
+    }
+
+    // The calling thread works too.
+    chunk_worker(chunk);
+
+    for (uint32_t t = 1; t < threads; t++) {
+        pthread_join(workers[t], NULL);
+    }
+}
+
+// Run a chunk in the background, so that master can serve requests meanwhile.
+static void* chunk_runner(void *arg) {
+    struct chunk_t *chunk = arg;
+    run_chunk(chunk, chunk->threads);
+    atomic_store(&chunk->finished, true);
+    return NULL;
+}
+
+// The next chunk out of remaining runs, for processes each with threads.
+// Chunks shrink as the sweep drains so the last runs are spread out.
+static uint32_t chunk_size(uint32_t remaining, uint32_t processes, uint32_t threads) {
+    uint32_t size = remaining / (2 * processes);
+    if (size < threads) {
+        size = threads;
+    }
+    if (size > remaining) {
+        size = remaining;
+    }
+    return size;
+}
+
+static void print_results(
+    const struct ensemble_t *self,
+    const struct member_result_t *results,
+    uint32_t len
+) {
+    printf("seed,density,threshold,iterations,tile_x,tile_y,color,ratio\n");
+    for (uint32_t m = 0; m < len; m++) {
+        uint64_t seed;
+        double density;
+        ensemble_run_params(self, m / self->thresholds.len, &seed, &density);
+        uint32_t threshold = self->thresholds.values[m % self->thresholds.len];
+
+        const struct member_result_t *r = &results[m];
+        if (r->iterations == 0) {
+            printf("%llu,%f,%u,,,,,\n",
+                (unsigned long long)seed, density, threshold);
+            continue;
+        }
+
+        printf("%llu,%f,%u,%u,%u,%u,%s,%f\n",
+            (unsigned long long)seed, density, threshold, r->iterations,
+            r->tile.tx, r->tile.ty, r->tile.color == BLUE ? "BLUE" : "RED",
+            r->tile.ratio * 100.0);
+    }
+}
+
+void ensemble_run(
+    const struct ensemble_t *self,
+    uint32_t grid_size,
+    uint32_t tile_size,
+    uint32_t max_iters,
+    uint32_t threads,
+    enum grid_layout layout,
+    const char *scratch,
+    uint32_t band_rows,
+    uint32_t id,
+    uint32_t num_procs
+) {
+    uint32_t len = ensemble_len(self);
+    uint32_t runs = ensemble_runs(self);
+    uint32_t per_run = self->thresholds.len;
+
+    struct chunk_t chunk;
+    chunk.ensemble = self;
+    chunk.grid_size = grid_size;
+    chunk.tile_size = tile_size;
+    chunk.max_iters = max_iters;
+    chunk.layout = layout;
+    chunk.scratch = scratch;
+    chunk.band_rows = band_rows;
+    chunk.threads = threads;
+
+    // On our own there is nobody to ask for work, run the lot.
+    if (num_procs == 1) {
+        struct member_result_t *results = malloc(len * sizeof(*results));
+        chunk.start = 0;
+        chunk.len = runs;
+        chunk.results = results;
+        run_chunk(&chunk, threads);
+        print_results(self, results, len);
+        free(results);
+        return;
+    }
+
+    if (id != 0) {
+        // Ask master for work, handing back the results of the previous chunk
+        // with each request. An empty chunk means we are done.
+        chunk.len = 0;
+        chunk.results = NULL;
+        while (true) {
+            MPI_Send(
+                chunk.results,
+                chunk.len * per_run * sizeof(struct member_result_t),
+                MPI_BYTE,
+                0,
+                MPI_ENSEMBLE_TAG,
+                MPI_COMM_WORLD);
+
+            uint32_t work[2];
+            MPI_Recv(
+                work, 2, MPI_UINT32_T, 0, MPI_ENSEMBLE_TAG, MPI_COMM_WORLD,
+                MPI_STATUS_IGNORE);
+
+            if (work[1] == 0) {
+                break;
+            }
+
+            chunk.start = work[0];
+            chunk.len = work[1];
+            chunk.results = realloc(
+                chunk.results,
+                chunk.len * per_run * sizeof(struct member_result_t));
+            run_chunk(&chunk, threads);
+        }
+        free(chunk.results);
+        return;
+    }
+
+    // Master: serve chunks until every worker has been told to stop, and run
+    // chunks of its own meanwhile. Only this thread may call MPI, so the
+    // chunks run on threads of their own while it looks for requests.
+    struct member_result_t *results = malloc(len * sizeof(*results));
+    struct member_result_t *incoming = malloc(len * sizeof(*incoming));
+    chunk.results = malloc(len * sizeof(*results));
+    uint32_t next = 0;
+    uint32_t active = num_procs - 1;
+    bool running = false;
+    pthread_t runner;
+
+    while (active > 0 || running || next < runs) {
+        if (running && atomic_load(&chunk.finished)) {
+            pthread_join(runner, NULL);
+            running = false;
+            for (uint32_t i = 0; i < chunk.len * per_run; i++) {
+                results[chunk.results[i].member] = chunk.results[i];
+            }
+        }
+
+        if (!running && next < runs) {
+            chunk.start = next;
+            chunk.len = chunk_size(runs - next, num_procs, threads);
+            next += chunk.len;
+            atomic_init(&chunk.finished, false);
+            pthread_create(&runner, NULL, chunk_runner, &chunk);
+            running = true;
+            continue;
+        }
+
+        if (active == 0) {
+            struct timespec wait = {0, 1000 * 1000};
+            nanosleep(&wait, NULL);
+            continue;
+        }
+
+        // Wait for a request outright once there is nothing of our own to
+        // finish, otherwise check back every so often.
+        MPI_Status status;
+        if (running) {
+            int flag;
+            MPI_Iprobe(
+                MPI_ANY_SOURCE, MPI_ENSEMBLE_TAG, MPI_COMM_WORLD, &flag, &status);
+            if (!flag) {
+                struct timespec wait = {0, 100 * 1000};
+                nanosleep(&wait, NULL);
+                continue;
+            }
+        } else {
+            MPI_Probe(MPI_ANY_SOURCE, MPI_ENSEMBLE_TAG, MPI_COMM_WORLD, &status);
+        }
+
+        int bytes;
+        MPI_Get_count(&status, MPI_BYTE, &bytes);
+        MPI_Recv(
+            incoming, bytes, MPI_BYTE, status.MPI_SOURCE, MPI_ENSEMBLE_TAG,
+            MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        uint32_t received = bytes / sizeof(struct member_result_t);
+        for (uint32_t i = 0; i < received; i++) {
+            results[incoming[i].member] = incoming[i];
+        }
+
+        uint32_t size = chunk_size(runs - next, num_procs, threads);
+        uint32_t work[2] = {next, size};
+        next += size;
+        MPI_Send(
+            work, 2, MPI_UINT32_T, status.MPI_SOURCE, MPI_ENSEMBLE_TAG,
+            MPI_COMM_WORLD);
+
+        if (size == 0) {
+            active--;
+        }
+    }
+
+    print_results(self, results, len);
+    free(chunk.results);
+    free(incoming);
+    free(results);
+}
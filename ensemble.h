@@ -0,0 +1,63 @@
+#ifndef _ENSEMBLE_H_
+#define _ENSEMBLE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "grid.h"
+#include "threshold.h"
+
+// A parameter sweep. Every combination of seed, density and threshold is one
+// member of the ensemble. All the thresholds of a seed and density come out of
+// a single simulation, a run.
+struct ensemble_t {
+    uint64_t base_seed;
+    uint32_t seeds;
+
+    // Fraction of cells that start RED, and the same fraction start BLUE.
+    double* densities;
+    uint32_t densities_len;
+
+    struct thresholds_t thresholds;
+};
+
+// The outcome of a single member. iterations is the first iteration at which
+// the threshold was reached, or 0 when max_iters ran out first.
+struct member_result_t {
+    uint32_t member;
+    uint32_t iterations;
+    struct tile_t tile;
+};
+
+// Parse a sweep specification such as
+//   "seeds=100;seed=42;density=0.2:0.4:0.05;threshold=50,75,90"
+// Lists are comma separated, and each item may be a start:stop:step range.
+// Returns false on a malformed specification.
+bool ensemble_parse(struct ensemble_t *self, const char *spec);
+
+void ensemble_free(struct ensemble_t *self);
+
+// Total number of members in the sweep.
+uint32_t ensemble_len(const struct ensemble_t *self);
+
+// Total number of simulations needed to cover the sweep.
+uint32_t ensemble_runs(const struct ensemble_t *self);
+
+// Run the whole sweep. Rank 0 hands out chunks of runs to the other ranks
+// as they ask for work, and prints the results; each rank runs its chunk on
+// threads threads, storing grids in the given layout. The stream layout keeps
+// each thread's grid in a file in scratch, band_rows rows at a time, see
+// stream_init. With a single rank, rank 0 runs everything itself.
+void ensemble_run(
+    const struct ensemble_t *self,
+    uint32_t grid_size,
+    uint32_t tile_size,
+    uint32_t max_iters,
+    uint32_t threads,
+    enum grid_layout layout,
+    const char *scratch,
+    uint32_t band_rows,
+    uint32_t id,
+    uint32_t num_procs);
+
+#endif
@@ -1,8 +1,10 @@
 #include "grid.h"
+#include "kernel.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Inclusive min and inclusive of max.
 uint32_t rand_range(uint32_t min, uint32_t max) {
@@ -15,6 +17,65 @@ uint32_t rand_range(uint32_t min, uint32_t max) {
     return (min + (r % (max + 1)));
 }
 
+// splitmix64, small and good enough to give every ensemble member its own
+// independent stream.
+static uint64_t rand_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void grid_alloc(struct grid_t *self, uint32_t size) {
+    self->size = size;
+    self->elements = (enum cell_type**)malloc(size * sizeof(enum cell_type*));
+    for (uint32_t r = 0; r < size; r++) {
+        self->elements[r] = (enum cell_type*)calloc(size, sizeof(enum cell_type));
+    }
+    self->boundary = (enum cell_type*)malloc(2 * size * sizeof(enum cell_type));
+}
+
+void grid_fill_random_row(
+    enum cell_type *cells,
+    uint32_t len,
+    double red,
+    double blue,
+    uint64_t *state
+) {
+    for (uint32_t c = 0; c < len; c++) {
+        double u = (rand_next(state) >> 11) * (1.0 / 9007199254740992.0);
+        if (u < red) {
+            cells[c] = RED;
+        } else if (u < red + blue) {
+            cells[c] = BLUE;
+        } else {
+            cells[c] = WHITE;
+        }
+    }
+}
+
+void grid_fill_random(
+    struct grid_t *self,
+    double red,
+    double blue,
+    uint64_t seed
+) {
+    uint64_t state = seed;
+    for (uint32_t r = 0; r < self->size; r++) {
+        grid_fill_random_row(self->elements[r], self->size, red, blue, &state);
+    }
+}
+
+void grid_free(struct grid_t *self) {
+    for (uint32_t r = 0; r < self->size; r++) {
+        free(self->elements[r]);
+    }
+    free(self->elements);
+    free(self->boundary);
+    self->elements = NULL;
+    self->boundary = NULL;
+}
+
 void grid_init(struct grid_t *self, uint32_t size) {
     self->size = size;
     self->elements = (enum cell_type**)malloc(size * sizeof(enum cell_type*));
@@ -24,6 +85,7 @@ void grid_init(struct grid_t *self, uint32_t size) {
             self->elements[r][c] = (enum cell_type)(rand_range(0, 2));
         }
     }
+    self->boundary = (enum cell_type*)malloc(2 * size * sizeof(enum cell_type));
 }
 
 void grid_init_copy(struct grid_t *self, const struct grid_t* copy) {
@@ -35,6 +97,7 @@ void grid_init_copy(struct grid_t *self, const struct grid_t* copy) {
             self->elements[r][c] = copy->elements[r][c];
         }
     }
+    self->boundary = (enum cell_type*)malloc(2 * copy->size * sizeof(enum cell_type));
 }
 
 void grid_copy(struct grid_t *self, const struct grid_t* source) {
@@ -112,51 +175,50 @@ bool grid_check_tiles(
 
     double delta = threshold / 100.0;
 
+    // One band of tiles at a time, the whole grid of counts would not fit
+    // on the stack, and for a big grid would hardly fit anywhere.
     uint32_t t_len = self->size / tile_size;
-    uint32_t b_tiles[t_len][t_len];
-    uint32_t r_tiles[t_len][t_len];
-
-    for (uint32_t r = 0; r < t_len; r++) {
-        for (uint32_t c = 0; c < t_len; c++) {
-            b_tiles[r][c] = 0;
-            r_tiles[r][c] = 0;
-        }
-    }
+    uint64_t* b_tiles = calloc(t_len, sizeof(uint64_t));
+    uint64_t* r_tiles = calloc(t_len, sizeof(uint64_t));
+    double cells_per_tile = (double)tile_size * tile_size;
 
     double ratio = 0.0;
 
     bool completed = false;
     for (uint32_t r = 0; r < self->size; r++) {
+        if (r % tile_size == 0) {
+            memset(b_tiles, 0, t_len * sizeof(uint64_t));
+            memset(r_tiles, 0, t_len * sizeof(uint64_t));
+        }
+
         for (uint32_t c = 0; c < self->size; c++) {
-            uint32_t tr = (int)(r / tile_size);
-            uint32_t tc = (int)(c / tile_size);
+            uint32_t tr = r / tile_size;
+            uint32_t tc = c / tile_size;
 
             switch (self->elements[r][c]) {
             case BLUE:
-                b_tiles[tr][tc]++;
-                ratio = b_tiles[tr][tc] / (double)(tile_size * tile_size);
+                b_tiles[tc]++;
+                ratio = b_tiles[tc] / cells_per_tile;
                 if (ratio >= delta) {
                     fprintf(
                         stderr,
-                        "Tile (c=%d, r=%d) has %f%% BLUE\n",
+                        "Tile (c=%u, r=%u) has %f%% BLUE\n",
                         tc,
                         tr,
-                        ratio * 100.0,
-                        threshold);
+                        ratio * 100.0);
                     completed = true;
                 }
                 break;
             case RED:
-                r_tiles[tr][tc]++;
-                ratio = r_tiles[tr][tc] / (double)(tile_size * tile_size);
+                r_tiles[tc]++;
+                ratio = r_tiles[tc] / cells_per_tile;
                 if (ratio >= delta) {
                     fprintf(
                         stderr,
-                        "Tile (c=%d, r=%d) has %f%% RED\n",
+                        "Tile (c=%u, r=%u) has %f%% RED\n",
                         tc,
                         tr,
-                        ratio * 100.0,
-                        threshold);
+                        ratio * 100.0);
                     completed = true;
                 }
                 break;
@@ -166,5 +228,102 @@ bool grid_check_tiles(
         }
     }
 
+    free(b_tiles);
+    free(r_tiles);
     return completed;
 }
+
+bool tile_better(const struct tile_t *a, const struct tile_t *b) {
+    if (a->ratio != b->ratio) {
+        return a->ratio > b->ratio;
+    }
+    if (a->ty != b->ty) {
+        return a->ty < b->ty;
+    }
+    if (a->tx != b->tx) {
+        return a->tx < b->tx;
+    }
+    return a->color < b->color;
+}
+
+void grid_max_tile(
+    const struct grid_t *self,
+    uint32_t tile_size,
+    struct tile_t *out
+) {
+    assert(self->size % tile_size == 0);
+
+    uint32_t t_len = self->size / tile_size;
+    uint64_t* b_counts = malloc(t_len * sizeof(uint64_t));
+    uint64_t* r_counts = malloc(t_len * sizeof(uint64_t));
+    double cells_per_tile = (double)tile_size * tile_size;
+
+    out->tx = 0;
+    out->ty = 0;
+    out->color = WHITE;
+    out->ratio = -1.0;
+
+    // One band of tiles at a time, so the counts stay small.
+    for (uint32_t ty = 0; ty < t_len; ty++) {
+        for (uint32_t tx = 0; tx < t_len; tx++) {
+            b_counts[tx] = 0;
+            r_counts[tx] = 0;
+        }
+
+        for (uint32_t r = ty * tile_size; r < (ty + 1) * tile_size; r++) {
+            for (uint32_t tx = 0; tx < t_len; tx++) {
+                kernel->count(
+                    self->elements[r] + tx * tile_size,
+                    tile_size,
+                    &b_counts[tx],
+                    &r_counts[tx]);
+            }
+        }
+
+        for (uint32_t tx = 0; tx < t_len; tx++) {
+            double blue_ratio = b_counts[tx] / cells_per_tile;
+            if (blue_ratio > out->ratio) {
+                out->tx = tx;
+                out->ty = ty;
+                out->color = BLUE;
+                out->ratio = blue_ratio;
+            }
+
+            double red_ratio = r_counts[tx] / cells_per_tile;
+            if (red_ratio > out->ratio) {
+                out->tx = tx;
+                out->ty = ty;
+                out->color = RED;
+                out->ratio = red_ratio;
+            }
+        }
+    }
+
+    free(b_counts);
+    free(r_counts);
+}
+
+void grid_step(struct grid_t *self) {
+    uint32_t size = self->size;
+    enum cell_type** rows = self->elements;
+
+    // RED movement -- red can move right. Each row only needs its first cell
+    // saved for the wraparound, which the kernel takes by value.
+    for (uint32_t r = 0; r < size; r++) {
+        enum cell_type* row = rows[r];
+        kernel->red(row, row, size, row[size-1], row[0]);
+    }
+
+    // BLUE movement -- blue can move down. Rows are worked from the top, with
+    // moved carrying the blues that leave each row into the next. The last row
+    // moves into row 0 as it was, so that is saved first.
+    enum cell_type* moved = self->boundary;
+    enum cell_type* first = self->boundary + size;
+    memcpy(first, rows[0], size * sizeof(enum cell_type));
+
+    kernel->blue_moved(rows[size-1], rows[0], moved, size);
+    for (uint32_t r = 0; r < size; r++) {
+        const enum cell_type* below = r + 1 < size ? rows[r+1] : first;
+        kernel->blue(rows[r], below, moved, size);
+    }
+}
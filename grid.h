@@ -10,13 +10,45 @@ enum cell_type {
     RED
 };
 
+// How serial and ensemble runs store the grid.
+enum grid_layout {
+    LAYOUT_ROWS,
+    LAYOUT_TILES,
+    LAYOUT_STREAM,
+};
+
 struct grid_t {
     enum cell_type** elements;
     uint32_t size;
+    // Two rows of working space for grid_step.
+    enum cell_type* boundary;
+};
+
+// The densest tile of a grid, as found by grid_max_tile.
+struct tile_t {
+    uint32_t tx;
+    uint32_t ty;
+    enum cell_type color;
+    double ratio;
 };
 
+// Allocate a size x size grid of WHITE cells.
+void grid_alloc(struct grid_t *self, uint32_t size);
+
 void grid_init(struct grid_t *self, uint32_t size);
 
+// Fill an allocated grid so that a fraction red of cells are RED and blue are
+// BLUE, drawing from a generator seeded with seed.
+void grid_fill_random(
+    struct grid_t *self, double red, double blue, uint64_t seed);
+
+// Fill the next row of a grid_fill_random grid, state starts out as the seed.
+// Lets a grid be generated a row at a time without holding all of it.
+void grid_fill_random_row(
+    enum cell_type *cells, uint32_t len, double red, double blue, uint64_t *state);
+
+void grid_free(struct grid_t *self);
+
 void grid_init_copy(struct grid_t *self, const struct grid_t* copy);
 
 void grid_copy(struct grid_t *self, const struct grid_t* source);
@@ -28,4 +60,16 @@ void grid_print(const struct grid_t *self, uint32_t tile_size);
 bool grid_check_tiles(
     const struct grid_t *self, uint32_t tile_size, uint32_t threshold);
 
+// True if tile a beats tile b: a higher ratio, or the same ratio and earlier
+// in the order grid_max_tile scans tiles.
+bool tile_better(const struct tile_t *a, const struct tile_t *b);
+
+// Find the tile with the highest ratio of a single colour. Ties go to the
+// first tile in row-major order, BLUE before RED.
+void grid_max_tile(
+    const struct grid_t *self, uint32_t tile_size, struct tile_t *out);
+
+// Perform one iteration, red then blue, in place.
+void grid_step(struct grid_t *self);
+
 #endif
@@ -0,0 +1,300 @@
+#include "halo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const int MPI_HALO_UP_TAG = 4;
+static const int MPI_HALO_DOWN_TAG = 5;
+
+// The two slots of a rowgroup.
+enum { FROM_ABOVE = 0, FROM_BELOW = 1 };
+
+static uint32_t halo_owner(const struct halo_t *self, uint32_t rowgroup) {
+    return self->row_owners[rowgroup * self->tile_size];
+}
+
+// Where the slot of a round lives within its owner's slots.
+static size_t halo_offset(
+    const struct halo_t *self,
+    uint32_t rowgroup,
+    int slot,
+    uint32_t round
+) {
+    size_t index = ((size_t)self->local[rowgroup] * 2 + round % 2) * 2 + slot;
+    return index * self->row_len;
+}
+
+// The link of a row sent from or to one of our rowgroups, by its index among
+// ours and the slot at the far end, or at ours.
+static size_t halo_link(const struct halo_t *self, uint32_t rowgroup, int slot) {
+    return (size_t)self->local[rowgroup] * 2 + slot;
+}
+
+// Number the rowgroups of each owner and allocate our slots for them.
+static void halo_alloc(struct halo_t *self) {
+    uint32_t counts[self->num_procs];
+    memset(counts, 0, sizeof(counts));
+    for (uint32_t g = 0; g < self->rowgroups; g++) {
+        self->local[g] = counts[halo_owner(self, g)]++;
+    }
+
+    size_t links = (size_t)counts[self->id] * 2;
+    size_t bytes = links * 2 * self->row_len * sizeof(enum cell_type);
+
+    // Delta links start from rows of zeros, which is all WHITE.
+    self->send_bufs = NULL;
+    self->recv_buf = NULL;
+    self->sent_prev = NULL;
+    self->recv_prev = NULL;
+    if (self->wire != WIRE_RAW && self->mode != HALO_RMA) {
+        self->send_bufs = malloc(links * self->wire_size);
+        self->recv_buf = malloc(self->wire_size);
+    }
+    if (self->wire == WIRE_DELTA && self->mode != HALO_RMA) {
+        size_t packed = wire_packed_size(self->row_len);
+        self->sent_prev = calloc(links, packed);
+        self->recv_prev = calloc(links, packed);
+    }
+
+    if (self->mode == HALO_MESSAGES) {
+        self->slots = malloc(bytes);
+        return;
+    }
+
+    if (self->mode == HALO_RMA) {
+        MPI_Win_allocate(
+            bytes, sizeof(enum cell_type), MPI_INFO_NULL, self->comm,
+            &self->slots, &self->win);
+        MPI_Win_fence(0, self->win);
+        return;
+    }
+
+    MPI_Win_allocate_shared(
+        bytes, sizeof(enum cell_type), MPI_INFO_NULL, self->node_comm,
+        &self->slots, &self->win);
+
+    int node_size;
+    MPI_Comm_size(self->node_comm, &node_size);
+    uint32_t ids[node_size];
+    MPI_Allgather(
+        &self->id, 1, MPI_UINT32_T, ids, 1, MPI_UINT32_T, self->node_comm);
+
+    for (uint32_t p = 0; p < self->num_procs; p++) {
+        self->peer_slots[p] = NULL;
+    }
+    for (int q = 0; q < node_size; q++) {
+        MPI_Aint size;
+        int disp_unit;
+        MPI_Win_shared_query(
+            self->win, q, &size, &disp_unit, &self->peer_slots[ids[q]]);
+    }
+
+    MPI_Win_fence(0, self->win);
+}
+
+static void halo_release(struct halo_t *self) {
+    free(self->send_bufs);
+    free(self->recv_buf);
+    free(self->sent_prev);
+    free(self->recv_prev);
+
+    if (self->mode == HALO_MESSAGES) {
+        free(self->slots);
+    } else {
+        MPI_Win_free(&self->win);
+    }
+    self->slots = NULL;
+}
+
+void halo_init(
+    struct halo_t *self,
+    MPI_Comm comm,
+    enum halo_mode mode,
+    enum wire_format wire,
+    uint32_t id,
+    uint32_t num_procs,
+    uint32_t grid_size,
+    uint32_t tile_size,
+    const uint32_t *row_owners
+) {
+    self->mode = mode;
+    self->wire = wire;
+    self->wire_size = wire_max_size(wire, grid_size);
+    self->comm = comm;
+    self->id = id;
+    self->num_procs = num_procs;
+    self->row_len = grid_size;
+    self->tile_size = tile_size;
+    self->rowgroups = grid_size / tile_size;
+    self->row_owners = row_owners;
+    self->local = malloc(self->rowgroups * sizeof(uint32_t));
+    self->round = 0;
+
+    // At most one row up and one down per rowgroup in a round.
+    self->requests = malloc(2 * self->rowgroups * sizeof(MPI_Request));
+    self->requests_len = 0;
+
+    self->node_comm = MPI_COMM_NULL;
+    self->win = MPI_WIN_NULL;
+    self->peer_slots = NULL;
+    if (mode == HALO_SHARED) {
+        MPI_Comm_split_type(
+            comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &self->node_comm);
+        self->peer_slots = malloc(num_procs * sizeof(enum cell_type*));
+    }
+
+    self->ranks = NULL;
+    if (mode == HALO_RMA) {
+        int size;
+        MPI_Comm_size(comm, &size);
+        uint32_t ids[size];
+        MPI_Allgather(&id, 1, MPI_UINT32_T, ids, 1, MPI_UINT32_T, comm);
+
+        self->ranks = malloc(num_procs * sizeof(int));
+        for (int rank = 0; rank < size; rank++) {
+            self->ranks[ids[rank]] = rank;
+        }
+    }
+
+    halo_alloc(self);
+}
+
+void halo_update(struct halo_t *self) {
+    halo_release(self);
+    halo_alloc(self);
+}
+
+static void halo_send(
+    struct halo_t *self,
+    uint32_t from,
+    uint32_t rowgroup,
+    int slot,
+    int tag,
+    const enum cell_type *cells
+) {
+    uint32_t owner = halo_owner(self, rowgroup);
+
+    if (self->mode == HALO_SHARED && self->peer_slots[owner] != NULL) {
+        size_t offset = halo_offset(self, rowgroup, slot, self->round);
+        memcpy(
+            self->peer_slots[owner] + offset, cells,
+            self->row_len * sizeof(enum cell_type));
+        return;
+    }
+
+    if (self->mode == HALO_RMA) {
+        MPI_Put(
+            cells, self->row_len, MPI_CELL_TYPE, self->ranks[owner],
+            halo_offset(self, rowgroup, slot, self->round),
+            self->row_len, MPI_CELL_TYPE, self->win);
+        return;
+    }
+
+    MPI_Request *request = &self->requests[self->requests_len++];
+    if (self->wire == WIRE_RAW) {
+        MPI_Isend(
+            cells, self->row_len, MPI_CELL_TYPE, owner, tag, MPI_COMM_WORLD,
+            request);
+        return;
+    }
+
+    size_t link = halo_link(self, from, slot);
+    uint8_t *out = self->send_bufs + link * self->wire_size;
+    uint8_t *prev = self->sent_prev == NULL ? NULL
+        : self->sent_prev + link * wire_packed_size(self->row_len);
+    size_t encoded = wire_encode(self->wire, cells, self->row_len, prev, out);
+    MPI_Isend(out, encoded, MPI_BYTE, owner, tag, MPI_COMM_WORLD, request);
+}
+
+void halo_send_up(
+    struct halo_t *self, uint32_t rowgroup, const enum cell_type *cells
+) {
+    uint32_t above = (rowgroup + self->rowgroups - 1) % self->rowgroups;
+    halo_send(self, rowgroup, above, FROM_BELOW, MPI_HALO_UP_TAG, cells);
+}
+
+void halo_send_down(
+    struct halo_t *self, uint32_t rowgroup, const enum cell_type *cells
+) {
+    uint32_t below = (rowgroup + 1) % self->rowgroups;
+    halo_send(self, rowgroup, below, FROM_ABOVE, MPI_HALO_DOWN_TAG, cells);
+}
+
+// Receive the messages for one direction, each from rowgroup src to
+// (src + shift) % rowgroups. Senders go in ascending rowgroup order, and so do
+// we, so the messages from any one process match up without looking at them.
+static void halo_receive(struct halo_t *self, uint32_t shift, int slot, int tag) {
+    for (uint32_t src = 0; src < self->rowgroups; src++) {
+        uint32_t dest = (src + shift) % self->rowgroups;
+        if (halo_owner(self, dest) != self->id) {
+            continue;
+        }
+
+        uint32_t from = halo_owner(self, src);
+        if (self->mode == HALO_SHARED && self->peer_slots[from] != NULL) {
+            continue;
+        }
+
+        enum cell_type *cells =
+            self->slots + halo_offset(self, dest, slot, self->round);
+        if (self->wire == WIRE_RAW) {
+            MPI_Recv(
+                cells, self->row_len, MPI_CELL_TYPE,
+                from, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            continue;
+        }
+
+        MPI_Recv(
+            self->recv_buf, self->wire_size, MPI_BYTE,
+            from, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        uint8_t *prev = self->recv_prev == NULL ? NULL
+            : self->recv_prev
+                + halo_link(self, dest, slot) * wire_packed_size(self->row_len);
+        wire_decode(self->wire, self->recv_buf, self->row_len, prev, cells);
+    }
+}
+
+void halo_wait(struct halo_t *self, bool up, bool down) {
+    if (self->mode != HALO_RMA) {
+        if (up) {
+            halo_receive(self, self->rowgroups - 1, FROM_BELOW, MPI_HALO_UP_TAG);
+        }
+        if (down) {
+            halo_receive(self, 1, FROM_ABOVE, MPI_HALO_DOWN_TAG);
+        }
+
+        MPI_Waitall(self->requests_len, self->requests, MPI_STATUSES_IGNORE);
+        self->requests_len = 0;
+    }
+
+    // Every write into a window was made before the fence. Nobody writes the
+    // same slots again until the round after next, by which time everyone has
+    // passed the next fence and so finished with this round.
+    if (self->mode != HALO_MESSAGES) {
+        MPI_Win_fence(0, self->win);
+    }
+
+    self->round++;
+}
+
+// The slots filled by the last round.
+const enum cell_type* halo_from_above(const struct halo_t *self, uint32_t rowgroup) {
+    return self->slots + halo_offset(self, rowgroup, FROM_ABOVE, self->round - 1);
+}
+
+const enum cell_type* halo_from_below(const struct halo_t *self, uint32_t rowgroup) {
+    return self->slots + halo_offset(self, rowgroup, FROM_BELOW, self->round - 1);
+}
+
+void halo_free(struct halo_t *self) {
+    halo_release(self);
+    free(self->local);
+    free(self->requests);
+    free(self->peer_slots);
+    free(self->ranks);
+    if (self->node_comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&self->node_comm);
+    }
+    MPI_Comm_free(&self->comm);
+}
@@ -0,0 +1,120 @@
+#ifndef _HALO_H_
+#define _HALO_H_
+
+#include <mpi.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "grid.h"
+#include "wire.h"
+
+// Rows travel as whole cells, so a message can hold as many cells as an int
+// count can.
+#define MPI_CELL_TYPE MPI_INT32_T
+_Static_assert(
+    sizeof(enum cell_type) == sizeof(int32_t), "cells are sent as MPI_INT32_T");
+
+// How boundary rows travel between slaves.
+enum halo_mode {
+    // Point to point messages.
+    HALO_MESSAGES,
+    // Shared memory between ranks on the same node, messages across nodes.
+    HALO_SHARED,
+    // One-sided puts into a window over every slave's slots.
+    HALO_RMA,
+};
+
+// The rows neighbouring rowgroups exchange during the blue phase. Every
+// rowgroup has two slots at its owner, one for a row sent down to it by the
+// rowgroup above and one for a row sent up to it by the rowgroup below.
+//
+// A round is a batch of sends, in ascending rowgroup order, followed by
+// halo_wait. Sent cells must not change until then. Afterwards the slots hold
+// what was sent, until the end of the next round. Slots are double buffered,
+// one set for odd and one for even rounds, so that a round can be filling one
+// set while slower processes still read the other.
+//
+// In shared mode the slots of every rank on a node live in one MPI-3 shared
+// memory window. Sending to a rowgroup on the same node is a copy straight into
+// its slot and the round ends with a fence; rowgroups on other nodes still get
+// a message.
+//
+// In RMA mode the slots of every slave form one window, rows are written into
+// them with MPI_Put and the round ends with a fence. Nothing has to be matched
+// on the receiving side.
+//
+// Rows sent as messages are encoded in a wire format, puts and copies into
+// shared memory always carry the cells as they are. For WIRE_DELTA every link,
+// from a rowgroup to the slot of its neighbour, remembers the last row sent
+// over it at both ends. These start from all WHITE again after halo_update.
+struct halo_t {
+    enum halo_mode mode;
+    enum wire_format wire;
+    MPI_Comm comm;
+    uint32_t id;
+    uint32_t num_procs;
+    uint32_t row_len;
+    uint32_t tile_size;
+    uint32_t rowgroups;
+    const uint32_t* row_owners;
+
+    // The index of each rowgroup among those of its owner.
+    uint32_t* local;
+    enum cell_type* slots;
+    uint32_t round;
+
+    // Shared mode: the slots of each process on our node, by process id, and
+    // NULL for the others.
+    MPI_Comm node_comm;
+    MPI_Win win;
+    enum cell_type** peer_slots;
+
+    // RMA mode: the rank in comm of each process id.
+    int* ranks;
+
+    MPI_Request* requests;
+    uint32_t requests_len;
+
+    // Encoded rows, one up and one down for each of our rowgroups, and a row
+    // being received. Not used with WIRE_RAW.
+    size_t wire_size;
+    uint8_t* send_bufs;
+    uint8_t* recv_buf;
+    // WIRE_DELTA: the packed rows last sent up and down by each of our
+    // rowgroups, and last received into each of our slots.
+    uint8_t* sent_prev;
+    uint8_t* recv_prev;
+};
+
+// Collective over comm, which must hold exactly the slaves with rows. Takes
+// ownership of comm. row_owners is read again by halo_update.
+void halo_init(
+    struct halo_t *self,
+    MPI_Comm comm,
+    enum halo_mode mode,
+    enum wire_format wire,
+    uint32_t id,
+    uint32_t num_procs,
+    uint32_t grid_size,
+    uint32_t tile_size,
+    const uint32_t *row_owners);
+
+// Collective, call after rowgroups have changed owner.
+void halo_update(struct halo_t *self);
+
+// Send cells to the slot of the rowgroup above or below rowgroup.
+void halo_send_up(
+    struct halo_t *self, uint32_t rowgroup, const enum cell_type *cells);
+void halo_send_down(
+    struct halo_t *self, uint32_t rowgroup, const enum cell_type *cells);
+
+// Finish a round in which rows were sent up and/or down.
+void halo_wait(struct halo_t *self, bool up, bool down);
+
+// The row sent to one of our rowgroups by the rowgroup above or below it.
+const enum cell_type* halo_from_above(const struct halo_t *self, uint32_t rowgroup);
+const enum cell_type* halo_from_below(const struct halo_t *self, uint32_t rowgroup);
+
+void halo_free(struct halo_t *self);
+
+#endif
@@ -0,0 +1,791 @@
+#include "kernel.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+// The state of a single cell after the red phase, given its neighbours.
+static inline enum cell_type red_cell(
+    enum cell_type prev,
+    enum cell_type cur,
+    enum cell_type next
+) {
+    if (cur == WHITE && prev == RED) {
+        return RED;
+    }
+    if (cur == RED && next == WHITE) {
+        return WHITE;
+    }
+    return cur;
+}
+
+// Finish a red span from start, the cells the caller's vectors did not reach.
+// prev is the cell before start as it was before the phase, which is left when
+// start is 0. Cells are worked forwards and each is read before it is written,
+// so out may be in. Returns the number of reds that moved.
+static inline uint32_t red_tail(
+    const enum cell_type* in,
+    enum cell_type* out,
+    uint32_t len,
+    enum cell_type prev,
+    enum cell_type right,
+    uint32_t start
+) {
+    uint32_t moves = 0;
+    for (uint32_t c = start; c < len; c++) {
+        enum cell_type cur = in[c];
+        enum cell_type next = c + 1 < len ? in[c+1] : right;
+        out[c] = red_cell(prev, cur, next);
+        moves += cur == RED && next == WHITE;
+        prev = cur;
+    }
+    return moves;
+}
+
+static uint32_t red_scalar(
+    const enum cell_type* in,
+    enum cell_type* out,
+    uint32_t len,
+    enum cell_type left,
+    enum cell_type right
+) {
+    return red_tail(in, out, len, left, right, 0);
+}
+
+static uint32_t blue_scalar(
+    enum cell_type* cur,
+    const enum cell_type* below,
+    enum cell_type* moved,
+    uint32_t len
+) {
+    uint32_t moves = 0;
+    for (uint32_t c = 0; c < len; c++) {
+        bool leaving = cur[c] == BLUE && below[c] == WHITE;
+        if (moved[c] == BLUE) {
+            cur[c] = BLUE;
+        } else if (leaving) {
+            cur[c] = WHITE;
+        }
+        moved[c] = leaving ? BLUE : WHITE;
+        moves += leaving;
+    }
+    return moves;
+}
+
+static void blue_moved_scalar(
+    const enum cell_type* above,
+    const enum cell_type* cur,
+    enum cell_type* moved,
+    uint32_t len
+) {
+    for (uint32_t c = 0; c < len; c++) {
+        moved[c] = above[c] == BLUE && cur[c] == WHITE ? BLUE : WHITE;
+    }
+}
+
+static void count_scalar(
+    const enum cell_type* in,
+    size_t len,
+    uint64_t* blue,
+    uint64_t* red
+) {
+    uint64_t b = 0;
+    uint64_t r = 0;
+    for (size_t c = 0; c < len; c++) {
+        b += in[c] == BLUE;
+        r += in[c] == RED;
+    }
+    *blue += b;
+    *red += r;
+}
+
+// Where cell c of a packed span lives: its byte, and the shift within it.
+static inline size_t pack_byte(uint32_t c) {
+    return (size_t)(c / 64) * 16 + c % 16;
+}
+
+static inline uint32_t pack_shift(uint32_t c) {
+    return 2 * (c % 64 / 16);
+}
+
+static void pack_scalar(const enum cell_type* cells, uint32_t len, uint8_t* out) {
+    memset(out, 0, ((size_t)len + 63) / 64 * 16);
+    for (uint32_t c = 0; c < len; c++) {
+        out[pack_byte(c)] |= cells[c] << pack_shift(c);
+    }
+}
+
+static void unpack_scalar(const uint8_t* in, uint32_t len, enum cell_type* cells) {
+    for (uint32_t c = 0; c < len; c++) {
+        cells[c] = (in[pack_byte(c)] >> pack_shift(c)) & 3;
+    }
+}
+
+static const struct kernel_t kernel_scalar = {
+    "scalar", red_scalar, blue_scalar, blue_moved_scalar, count_scalar,
+    pack_scalar, unpack_scalar
+};
+
+#ifdef KERNEL_X86
+
+// The vector kernels all follow the same recipe. Since WHITE is zero the new
+// cell is (cur & ~leaving) | (arriving & colour).
+//
+// Red works forwards so that it can run in place. The cell before a vector may
+// already have been written, so prev is made by shifting cur up a lane and
+// carrying in the last cell of the previous vector, as it was when loaded.
+
+// Add up the lanes of a vector of counts.
+__attribute__((target("sse2")))
+static inline uint32_t lanes_sum_sse2(__m128i v) {
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("sse2")))
+static uint32_t red_sse2(
+    const enum cell_type* in,
+    enum cell_type* out,
+    uint32_t len,
+    enum cell_type left,
+    enum cell_type right
+) {
+    const __m128i white = _mm_set1_epi32(WHITE);
+    const __m128i red = _mm_set1_epi32(RED);
+    enum cell_type carry = left;
+    __m128i moves = _mm_setzero_si128();
+
+    // Vectors stop while in[c+4] is in the span.
+    uint32_t c = 0;
+    for (; c + 5 <= len; c += 4) {
+        __m128i cur = _mm_loadu_si128((const __m128i*)(in + c));
+        __m128i next = _mm_loadu_si128((const __m128i*)(in + c + 1));
+        __m128i prev = _mm_or_si128(
+            _mm_slli_si128(cur, 4), _mm_cvtsi32_si128(carry));
+        carry = _mm_cvtsi128_si32(_mm_srli_si128(cur, 12));
+
+        __m128i arriving = _mm_and_si128(
+            _mm_cmpeq_epi32(cur, white), _mm_cmpeq_epi32(prev, red));
+        __m128i leaving = _mm_and_si128(
+            _mm_cmpeq_epi32(cur, red), _mm_cmpeq_epi32(next, white));
+
+        __m128i res = _mm_or_si128(
+            _mm_andnot_si128(leaving, cur), _mm_and_si128(arriving, red));
+        _mm_storeu_si128((__m128i*)(out + c), res);
+        moves = _mm_sub_epi32(moves, leaving);
+    }
+
+    return lanes_sum_sse2(moves) + red_tail(in, out, len, carry, right, c);
+}
+
+__attribute__((target("sse2")))
+static uint32_t blue_sse2(
+    enum cell_type* cur,
+    const enum cell_type* below,
+    enum cell_type* moved,
+    uint32_t len
+) {
+    const __m128i white = _mm_set1_epi32(WHITE);
+    const __m128i blue = _mm_set1_epi32(BLUE);
+    __m128i moves = _mm_setzero_si128();
+
+    uint32_t c = 0;
+    for (; c + 4 <= len; c += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(cur + c));
+        __m128i b = _mm_loadu_si128((const __m128i*)(below + c));
+        __m128i m = _mm_loadu_si128((const __m128i*)(moved + c));
+
+        __m128i arriving = _mm_cmpeq_epi32(m, blue);
+        __m128i leaving = _mm_and_si128(
+            _mm_cmpeq_epi32(x, blue), _mm_cmpeq_epi32(b, white));
+
+        __m128i res = _mm_or_si128(
+            _mm_andnot_si128(leaving, x), _mm_and_si128(arriving, blue));
+        _mm_storeu_si128((__m128i*)(cur + c), res);
+        _mm_storeu_si128((__m128i*)(moved + c), _mm_and_si128(leaving, blue));
+        moves = _mm_sub_epi32(moves, leaving);
+    }
+
+    return lanes_sum_sse2(moves)
+        + blue_scalar(cur + c, below + c, moved + c, len - c);
+}
+
+__attribute__((target("sse2")))
+static void blue_moved_sse2(
+    const enum cell_type* above,
+    const enum cell_type* cur,
+    enum cell_type* moved,
+    uint32_t len
+) {
+    const __m128i white = _mm_set1_epi32(WHITE);
+    const __m128i blue = _mm_set1_epi32(BLUE);
+
+    uint32_t c = 0;
+    for (; c + 4 <= len; c += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(above + c));
+        __m128i x = _mm_loadu_si128((const __m128i*)(cur + c));
+        __m128i leaving = _mm_and_si128(
+            _mm_cmpeq_epi32(a, blue), _mm_cmpeq_epi32(x, white));
+        _mm_storeu_si128((__m128i*)(moved + c), _mm_and_si128(leaving, blue));
+    }
+
+    blue_moved_scalar(above + c, cur + c, moved + c, len - c);
+}
+
+// The vector counts keep a 32-bit counter per lane, so long spans are counted
+// a chunk at a time that no lane can overflow.
+static const size_t COUNT_CHUNK = (size_t)1 << 31;
+
+static inline void count_chunked(
+    void (*count)(const enum cell_type*, uint32_t, uint64_t*, uint64_t*),
+    const enum cell_type* in,
+    size_t len,
+    uint64_t* blue,
+    uint64_t* red
+) {
+    for (size_t c = 0; c < len; c += COUNT_CHUNK) {
+        size_t n = len - c < COUNT_CHUNK ? len - c : COUNT_CHUNK;
+        count(in + c, (uint32_t)n, blue, red);
+    }
+}
+
+__attribute__((target("sse2")))
+static void count_sse2_chunk(
+    const enum cell_type* in,
+    uint32_t len,
+    uint64_t* blue,
+    uint64_t* red
+) {
+    const __m128i blue_v = _mm_set1_epi32(BLUE);
+    const __m128i red_v = _mm_set1_epi32(RED);
+    __m128i b = _mm_setzero_si128();
+    __m128i r = _mm_setzero_si128();
+
+    // Matching lanes compare to -1, so subtracting counts them.
+    uint32_t c = 0;
+    for (; c + 4 <= len; c += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + c));
+        b = _mm_sub_epi32(b, _mm_cmpeq_epi32(x, blue_v));
+        r = _mm_sub_epi32(r, _mm_cmpeq_epi32(x, red_v));
+    }
+
+    *blue += lanes_sum_sse2(b);
+    *red += lanes_sum_sse2(r);
+
+    count_scalar(in + c, len - c, blue, red);
+}
+
+static void count_sse2(
+    const enum cell_type* in,
+    size_t len,
+    uint64_t* blue,
+    uint64_t* red
+) {
+    count_chunked(count_sse2_chunk, in, len, blue, red);
+}
+
+// A group of 64 cells packs as four vectors of cells shifted into place and
+// or'ed, whose lanes are then narrowed to bytes. Unpacking widens the bytes
+// back to lanes and shifts each cell out in turn. The ragged end of a span is
+// left to the scalar code, which packs whole groups too.
+__attribute__((target("sse2")))
+static void pack_sse2(const enum cell_type* cells, uint32_t len, uint8_t* out) {
+    uint32_t c = 0;
+    for (; c + 64 <= len; c += 64) {
+        __m128i w[4];
+        for (int q = 0; q < 4; q++) {
+            const __m128i* at = (const __m128i*)(cells + c + 4 * q);
+            w[q] = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_loadu_si128(at),
+                    _mm_slli_epi32(_mm_loadu_si128(at + 4), 2)),
+                _mm_or_si128(
+                    _mm_slli_epi32(_mm_loadu_si128(at + 8), 4),
+                    _mm_slli_epi32(_mm_loadu_si128(at + 12), 6)));
+        }
+        __m128i bytes = _mm_packus_epi16(
+            _mm_packs_epi32(w[0], w[1]), _mm_packs_epi32(w[2], w[3]));
+        _mm_storeu_si128((__m128i*)(out + c / 4), bytes);
+    }
+
+    if (c < len) {
+        pack_scalar(cells + c, len - c, out + c / 4);
+    }
+}
+
+__attribute__((target("sse2")))
+static void unpack_sse2(const uint8_t* in, uint32_t len, enum cell_type* cells) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi32(3);
+
+    uint32_t c = 0;
+    for (; c + 64 <= len; c += 64) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + c / 4));
+        __m128i lo = _mm_unpacklo_epi8(x, zero);
+        __m128i hi = _mm_unpackhi_epi8(x, zero);
+        __m128i b[4] = {
+            _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+            _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero),
+        };
+        for (int k = 0; k < 4; k++) {
+            for (int q = 0; q < 4; q++) {
+                _mm_storeu_si128(
+                    (__m128i*)(cells + c + 16 * k + 4 * q),
+                    _mm_and_si128(_mm_srli_epi32(b[q], 2 * k), mask));
+            }
+        }
+    }
+
+    unpack_scalar(in + c / 4, len - c, cells + c);
+}
+
+static const struct kernel_t kernel_sse2 = {
+    "sse2", red_sse2, blue_sse2, blue_moved_sse2, count_sse2,
+    pack_sse2, unpack_sse2
+};
+
+// Add up the lanes of a vector of counts.
+__attribute__((target("avx2")))
+static inline uint32_t lanes_sum_avx2(__m256i v) {
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, v);
+    uint32_t sum = 0;
+    for (int i = 0; i < 8; i++) {
+        sum += lanes[i];
+    }
+    return sum;
+}
+
+// The new cells, counting the reds that leave into moves.
+__attribute__((target("avx2")))
+static inline __m256i red_vec_avx2(
+    __m256i prev, __m256i cur, __m256i next, __m256i* moves
+) {
+    const __m256i white = _mm256_set1_epi32(WHITE);
+    const __m256i red = _mm256_set1_epi32(RED);
+
+    __m256i arriving = _mm256_and_si256(
+        _mm256_cmpeq_epi32(cur, white), _mm256_cmpeq_epi32(prev, red));
+    __m256i leaving = _mm256_and_si256(
+        _mm256_cmpeq_epi32(cur, red), _mm256_cmpeq_epi32(next, white));
+    *moves = _mm256_sub_epi32(*moves, leaving);
+
+    return _mm256_or_si256(
+        _mm256_andnot_si256(leaving, cur), _mm256_and_si256(arriving, red));
+}
+
+// cur shifted up a lane, with carry in the first.
+__attribute__((target("avx2")))
+static inline __m256i red_prev_avx2(__m256i cur, enum cell_type carry) {
+    const __m256i up = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+    return _mm256_blend_epi32(
+        _mm256_permutevar8x32_epi32(cur, up), _mm256_set1_epi32(carry), 1);
+}
+
+__attribute__((target("avx2")))
+static uint32_t red_avx2(
+    const enum cell_type* in,
+    enum cell_type* out,
+    uint32_t len,
+    enum cell_type left,
+    enum cell_type right
+) {
+    enum cell_type carry = left;
+    __m256i moves = _mm256_setzero_si256();
+
+    uint32_t c = 0;
+    for (; c + 9 <= len; c += 8) {
+        __m256i cur = _mm256_loadu_si256((const __m256i*)(in + c));
+        __m256i next = _mm256_loadu_si256((const __m256i*)(in + c + 1));
+        __m256i prev = red_prev_avx2(cur, carry);
+        carry = _mm256_extract_epi32(cur, 7);
+        _mm256_storeu_si256(
+            (__m256i*)(out + c), red_vec_avx2(prev, cur, next, &moves));
+    }
+
+    if (c == len) {
+        return lanes_sum_avx2(moves);
+    }
+
+    // The last 1 to 8 cells. Masked loads never touch cells outside the span,
+    // right is blended in instead.
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i rest = _mm256_set1_epi32((int)(len - c));
+    __m256i inside = _mm256_cmpgt_epi32(rest, lane);
+    __m256i has_next = _mm256_cmpgt_epi32(
+        _mm256_sub_epi32(rest, _mm256_set1_epi32(1)), lane);
+
+    const int* cells = (const int*)in + c;
+    __m256i cur = _mm256_maskload_epi32(cells, inside);
+    __m256i next = _mm256_blendv_epi8(
+        _mm256_set1_epi32(right), _mm256_maskload_epi32(cells + 1, has_next),
+        has_next);
+    __m256i prev = red_prev_avx2(cur, carry);
+
+    // Lanes outside the span load as WHITE, so never count as moving.
+    _mm256_maskstore_epi32(
+        (int*)out + c, inside, red_vec_avx2(prev, cur, next, &moves));
+    return lanes_sum_avx2(moves);
+}
+
+__attribute__((target("avx2")))
+static uint32_t blue_avx2(
+    enum cell_type* cur,
+    const enum cell_type* below,
+    enum cell_type* moved,
+    uint32_t len
+) {
+    const __m256i white = _mm256_set1_epi32(WHITE);
+    const __m256i blue = _mm256_set1_epi32(BLUE);
+    __m256i moves = _mm256_setzero_si256();
+
+    uint32_t c = 0;
+    for (; c + 8 <= len; c += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(cur + c));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(below + c));
+        __m256i m = _mm256_loadu_si256((const __m256i*)(moved + c));
+
+        __m256i arriving = _mm256_cmpeq_epi32(m, blue);
+        __m256i leaving = _mm256_and_si256(
+            _mm256_cmpeq_epi32(x, blue), _mm256_cmpeq_epi32(b, white));
+
+        __m256i res = _mm256_or_si256(
+            _mm256_andnot_si256(leaving, x), _mm256_and_si256(arriving, blue));
+        _mm256_storeu_si256((__m256i*)(cur + c), res);
+        _mm256_storeu_si256(
+            (__m256i*)(moved + c), _mm256_and_si256(leaving, blue));
+        moves = _mm256_sub_epi32(moves, leaving);
+    }
+
+    return lanes_sum_avx2(moves)
+        + blue_scalar(cur + c, below + c, moved + c, len - c);
+}
+
+__attribute__((target("avx2")))
+static void blue_moved_avx2(
+    const enum cell_type* above,
+    const enum cell_type* cur,
+    enum cell_type* moved,
+    uint32_t len
+) {
+    const __m256i white = _mm256_set1_epi32(WHITE);
+    const __m256i blue = _mm256_set1_epi32(BLUE);
+
+    uint32_t c = 0;
+    for (; c + 8 <= len; c += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(above + c));
+        __m256i x = _mm256_loadu_si256((const __m256i*)(cur + c));
+        __m256i leaving = _mm256_and_si256(
+            _mm256_cmpeq_epi32(a, blue), _mm256_cmpeq_epi32(x, white));
+        _mm256_storeu_si256(
+            (__m256i*)(moved + c), _mm256_and_si256(leaving, blue));
+    }
+
+    blue_moved_scalar(above + c, cur + c, moved + c, len - c);
+}
+
+__attribute__((target("avx2")))
+static void count_avx2_chunk(
+    const enum cell_type* in,
+    uint32_t len,
+    uint64_t* blue,
+    uint64_t* red
+) {
+    const __m256i blue_v = _mm256_set1_epi32(BLUE);
+    const __m256i red_v = _mm256_set1_epi32(RED);
+    __m256i b = _mm256_setzero_si256();
+    __m256i r = _mm256_setzero_si256();
+
+    uint32_t c = 0;
+    for (; c + 8 <= len; c += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + c));
+        b = _mm256_sub_epi32(b, _mm256_cmpeq_epi32(x, blue_v));
+        r = _mm256_sub_epi32(r, _mm256_cmpeq_epi32(x, red_v));
+    }
+
+    *blue += lanes_sum_avx2(b);
+    *red += lanes_sum_avx2(r);
+
+    count_scalar(in + c, len - c, blue, red);
+}
+
+static void count_avx2(
+    const enum cell_type* in,
+    size_t len,
+    uint64_t* blue,
+    uint64_t* red
+) {
+    count_chunked(count_avx2_chunk, in, len, blue, red);
+}
+
+__attribute__((target("avx2")))
+static void pack_avx2(const enum cell_type* cells, uint32_t len, uint8_t* out) {
+    uint32_t c = 0;
+    for (; c + 64 <= len; c += 64) {
+        __m128i half[4];
+        for (int h = 0; h < 2; h++) {
+            const __m256i* at = (const __m256i*)(cells + c + 8 * h);
+            __m256i w = _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_loadu_si256(at),
+                    _mm256_slli_epi32(_mm256_loadu_si256(at + 2), 2)),
+                _mm256_or_si256(
+                    _mm256_slli_epi32(_mm256_loadu_si256(at + 4), 4),
+                    _mm256_slli_epi32(_mm256_loadu_si256(at + 6), 6)));
+            half[2 * h] = _mm256_castsi256_si128(w);
+            half[2 * h + 1] = _mm256_extracti128_si256(w, 1);
+        }
+        __m128i bytes = _mm_packus_epi16(
+            _mm_packs_epi32(half[0], half[1]), _mm_packs_epi32(half[2], half[3]));
+        _mm_storeu_si128((__m128i*)(out + c / 4), bytes);
+    }
+
+    if (c < len) {
+        pack_scalar(cells + c, len - c, out + c / 4);
+    }
+}
+
+__attribute__((target("avx2")))
+static void unpack_avx2(const uint8_t* in, uint32_t len, enum cell_type* cells) {
+    const __m256i mask = _mm256_set1_epi32(3);
+
+    uint32_t c = 0;
+    for (; c + 64 <= len; c += 64) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + c / 4));
+        __m256i b[2] = {
+            _mm256_cvtepu8_epi32(x), _mm256_cvtepu8_epi32(_mm_srli_si128(x, 8)),
+        };
+        for (int k = 0; k < 4; k++) {
+            for (int h = 0; h < 2; h++) {
+                _mm256_storeu_si256(
+                    (__m256i*)(cells + c + 16 * k + 8 * h),
+                    _mm256_and_si256(_mm256_srli_epi32(b[h], 2 * k), mask));
+            }
+        }
+    }
+
+    unpack_scalar(in + c / 4, len - c, cells + c);
+}
+
+static const struct kernel_t kernel_avx2 = {
+    "avx2", red_avx2, blue_avx2, blue_moved_avx2, count_avx2,
+    pack_avx2, unpack_avx2
+};
+
+// AVX-512 has mask registers, so the masked moves replace the and/or blend and
+// the ends of a span are handled with masked loads and stores instead of scalar
+// code. Short spans, such as the rows of a small tile, stay vectorized.
+
+__attribute__((target("avx512f,popcnt")))
+static uint32_t red_avx512(
+    const enum cell_type* in,
+    enum cell_type* out,
+    uint32_t len,
+    enum cell_type left,
+    enum cell_type right
+) {
+    const __m512i white = _mm512_set1_epi32(WHITE);
+    const __m512i red = _mm512_set1_epi32(RED);
+    const __m512i right_v = _mm512_set1_epi32(right);
+
+    // The last lane of carry is the cell before the vector.
+    __m512i carry = _mm512_set1_epi32(left);
+    uint32_t moves = 0;
+
+    for (uint32_t c = 0; c < len; c += 16) {
+        __mmask16 lanes = len - c >= 16 ? 0xFFFF : (1u << (len - c)) - 1;
+
+        // Lanes without a next cell inside the span take right.
+        __mmask16 has_next = len - c > 16 ? lanes : lanes >> 1;
+
+        const int* cells = (const int*)in + c;
+        __m512i cur = _mm512_maskz_loadu_epi32(lanes, cells);
+        __m512i next = _mm512_mask_loadu_epi32(right_v, has_next, cells + 1);
+        __m512i prev = _mm512_alignr_epi32(cur, carry, 15);
+        carry = cur;
+
+        __mmask16 arriving = _mm512_cmpeq_epi32_mask(cur, white)
+            & _mm512_cmpeq_epi32_mask(prev, red);
+        __mmask16 leaving = _mm512_cmpeq_epi32_mask(cur, red)
+            & _mm512_cmpeq_epi32_mask(next, white);
+
+        __m512i res = _mm512_mask_mov_epi32(cur, arriving, red);
+        res = _mm512_mask_mov_epi32(res, leaving, white);
+        _mm512_mask_storeu_epi32(out + c, lanes, res);
+        moves += _mm_popcnt_u32(leaving);
+    }
+    return moves;
+}
+
+__attribute__((target("avx512f,popcnt")))
+static uint32_t blue_avx512(
+    enum cell_type* cur,
+    const enum cell_type* below,
+    enum cell_type* moved,
+    uint32_t len
+) {
+    const __m512i white = _mm512_set1_epi32(WHITE);
+    const __m512i blue = _mm512_set1_epi32(BLUE);
+    uint32_t moves = 0;
+
+    for (uint32_t c = 0; c < len; c += 16) {
+        __mmask16 lanes = len - c >= 16 ? 0xFFFF : (1u << (len - c)) - 1;
+
+        __m512i x = _mm512_maskz_loadu_epi32(lanes, cur + c);
+        __m512i b = _mm512_maskz_loadu_epi32(lanes, below + c);
+        __m512i m = _mm512_maskz_loadu_epi32(lanes, moved + c);
+
+        __mmask16 arriving = _mm512_cmpeq_epi32_mask(m, blue);
+        __mmask16 leaving = _mm512_cmpeq_epi32_mask(x, blue)
+            & _mm512_cmpeq_epi32_mask(b, white);
+
+        __m512i res = _mm512_mask_mov_epi32(x, arriving, blue);
+        res = _mm512_mask_mov_epi32(res, leaving, white);
+        _mm512_mask_storeu_epi32(cur + c, lanes, res);
+        _mm512_mask_storeu_epi32(
+            moved + c, lanes, _mm512_maskz_mov_epi32(leaving, blue));
+        moves += _mm_popcnt_u32(leaving);
+    }
+    return moves;
+}
+
+__attribute__((target("avx512f")))
+static void blue_moved_avx512(
+    const enum cell_type* above,
+    const enum cell_type* cur,
+    enum cell_type* moved,
+    uint32_t len
+) {
+    const __m512i white = _mm512_set1_epi32(WHITE);
+    const __m512i blue = _mm512_set1_epi32(BLUE);
+
+    for (uint32_t c = 0; c < len; c += 16) {
+        __mmask16 lanes = len - c >= 16 ? 0xFFFF : (1u << (len - c)) - 1;
+
+        __m512i a = _mm512_maskz_loadu_epi32(lanes, above + c);
+        __m512i x = _mm512_maskz_loadu_epi32(lanes, cur + c);
+        __mmask16 leaving = _mm512_cmpeq_epi32_mask(a, blue)
+            & _mm512_cmpeq_epi32_mask(x, white);
+
+        _mm512_mask_storeu_epi32(
+            moved + c, lanes, _mm512_maskz_mov_epi32(leaving, blue));
+    }
+}
+
+__attribute__((target("avx512f,popcnt")))
+static void count_avx512(
+    const enum cell_type* in,
+    size_t len,
+    uint64_t* blue,
+    uint64_t* red
+) {
+    const __m512i blue_v = _mm512_set1_epi32(BLUE);
+    const __m512i red_v = _mm512_set1_epi32(RED);
+    uint64_t b = 0;
+    uint64_t r = 0;
+
+    for (size_t c = 0; c < len; c += 16) {
+        __mmask16 lanes = len - c >= 16 ? 0xFFFF : (1u << (len - c)) - 1;
+        __m512i x = _mm512_maskz_loadu_epi32(lanes, in + c);
+        b += _mm_popcnt_u32(_mm512_mask_cmpeq_epi32_mask(lanes, x, blue_v));
+        r += _mm_popcnt_u32(_mm512_mask_cmpeq_epi32_mask(lanes, x, red_v));
+    }
+
+    *blue += b;
+    *red += r;
+}
+
+// A whole group is one vector of bytes, so the ragged end is just masked.
+__attribute__((target("avx512f")))
+static void pack_avx512(const enum cell_type* cells, uint32_t len, uint8_t* out) {
+    for (uint32_t c = 0; c < len; c += 64) {
+        __m512i w = _mm512_setzero_si512();
+        for (uint32_t k = 0; k < 4; k++) {
+            uint32_t start = c + 16 * k;
+            __mmask16 lanes = start >= len ? 0
+                : len - start >= 16 ? 0xFFFF : (1u << (len - start)) - 1;
+            __m512i x = _mm512_maskz_loadu_epi32(lanes, cells + start);
+            w = _mm512_or_si512(w, _mm512_slli_epi32(x, 2 * k));
+        }
+        _mm_storeu_si128((__m128i*)(out + c / 4), _mm512_cvtepi32_epi8(w));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void unpack_avx512(const uint8_t* in, uint32_t len, enum cell_type* cells) {
+    const __m512i mask = _mm512_set1_epi32(3);
+
+    for (uint32_t c = 0; c < len; c += 64) {
+        __m512i b = _mm512_cvtepu8_epi32(
+            _mm_loadu_si128((const __m128i*)(in + c / 4)));
+        for (uint32_t k = 0; k < 4; k++) {
+            uint32_t start = c + 16 * k;
+            __mmask16 lanes = start >= len ? 0
+                : len - start >= 16 ? 0xFFFF : (1u << (len - start)) - 1;
+            _mm512_mask_storeu_epi32(
+                cells + start, lanes,
+                _mm512_and_si512(_mm512_srli_epi32(b, 2 * k), mask));
+        }
+    }
+}
+
+static const struct kernel_t kernel_avx512 = {
+    "avx512", red_avx512, blue_avx512, blue_moved_avx512, count_avx512,
+    pack_avx512, unpack_avx512
+};
+
+#endif
+
+const struct kernel_t* kernel = &kernel_scalar;
+
+// Whether this CPU can run the named kernel.
+static bool kernel_supported(const struct kernel_t* k) {
+#ifdef KERNEL_X86
+    __builtin_cpu_init();
+    if (k == &kernel_avx512) {
+        return __builtin_cpu_supports("avx512f")
+            && __builtin_cpu_supports("popcnt");
+    }
+    if (k == &kernel_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (k == &kernel_sse2) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return k == &kernel_scalar;
+}
+
+bool kernel_init(const char* name) {
+    // Best first.
+    const struct kernel_t* kernels[] = {
+#ifdef KERNEL_X86
+        &kernel_avx512,
+        &kernel_avx2,
+        &kernel_sse2,
+#endif
+        &kernel_scalar,
+    };
+    size_t kernels_len = sizeof(kernels) / sizeof(kernels[0]);
+
+    for (size_t i = 0; i < kernels_len; i++) {
+        if (name != NULL && strcmp(name, kernels[i]->name) != 0) {
+            continue;
+        }
+        if (!kernel_supported(kernels[i])) {
+            if (name != NULL) {
+                return false;
+            }
+            continue;
+        }
+        kernel = kernels[i];
+        return true;
+    }
+
+    return false;
+}
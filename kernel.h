@@ -0,0 +1,68 @@
+#ifndef _KERNEL_H_
+#define _KERNEL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "grid.h"
+
+// The per-cell work of an iteration, over a contiguous span of cells. Every
+// kernel computes exactly the same result; they differ only in the
+// instructions used.
+struct kernel_t {
+    const char* name;
+
+    // Red phase: out is the span after reds have moved right. left and right
+    // are the cells either side of the span, for a full row these wrap around.
+    // out may be in, each cell is read before it is written. Returns the
+    // number of reds that moved.
+    uint32_t (*red)(
+        const enum cell_type* in,
+        enum cell_type* out,
+        uint32_t len,
+        enum cell_type left,
+        enum cell_type right);
+
+    // Blue phase, in place, on the rows of a column worked from the top down.
+    // moved holds the blues that left the row above; they arrive in cur, and
+    // moved is replaced by the blues that leave cur for below. Returns the
+    // number of those.
+    uint32_t (*blue)(
+        enum cell_type* cur,
+        const enum cell_type* below,
+        enum cell_type* moved,
+        uint32_t len);
+
+    // Start a column: fill moved with the blues that leave above for cur.
+    void (*blue_moved)(
+        const enum cell_type* above,
+        const enum cell_type* cur,
+        enum cell_type* moved,
+        uint32_t len);
+
+    // Add the number of BLUE and RED cells in the span to blue and red. A span
+    // may be a whole tile, so it can hold more than 2^32 cells.
+    void (*count)(
+        const enum cell_type* in,
+        size_t len,
+        uint64_t* blue,
+        uint64_t* red);
+
+    // Pack cells at 2 bits each into wire_packed_size(len) bytes, and back.
+    // Cells go in groups of 64, 16 bytes each, and byte j of a group holds
+    // cells j, j+16, j+32 and j+48 from the low bits up. Every kernel packs
+    // to the same bytes.
+    void (*pack)(const enum cell_type* cells, uint32_t len, uint8_t* out);
+    void (*unpack)(const uint8_t* in, uint32_t len, enum cell_type* cells);
+};
+
+// The kernel in use, the scalar one until kernel_init is called.
+extern const struct kernel_t* kernel;
+
+// Select a kernel by name ("scalar", "sse2", "avx2" or "avx512"), or the best
+// this CPU supports when name is NULL. Returns false when the kernel is
+// unknown or the CPU cannot run it.
+bool kernel_init(const char* name);
+
+#endif
@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <argp.h>
 #include <execinfo.h>
+#include <limits.h>
 #include <mpi.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -10,32 +11,68 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <unistd.h>
 
+#include "balance.h"
+#include "ensemble.h"
 #include "grid.h"
+#include "halo.h"
+#include "kernel.h"
+#include "perf.h"
 #include "row.h"
+#include "stats.h"
+#include "stream.h"
+#include "termination.h"
+#include "threshold.h"
+#include "tiled.h"
 
 const int MPI_DEFAULT_TAG = 1;
 const int MPI_MASTER_ID = 0;
+const int MPI_MIGRATE_TAG = 3;
 
 // name, key, arg name, falgs, doc, group
 static struct argp_option options[] = {
     {"gridsize",  'n', "grid_size", 0, "Size of the grid."},
     {"tilesize",  't', "tile_size", 0, "Size of the tile."},
-    {"threshold", 'c', "threshold", 0, "The threshold."},
+    {"threshold", 'c', "threshold", 0, "The threshold, or a comma separated list."},
     {"max_iters", 'm', "max_iters", 0, "Max iterations."},
     {"verbose",   'v', 0,           0, "Verbose mode."},
     {"print",     'p', 0,           0, "Print."},
+    {"ensemble",  'e', "spec",      0, "Run a sweep of independent simulations."},
+    {"threads",   'T', "threads",   0, "Threads per process for ensemble runs."},
+    {"kernel",    'k', "kernel",    0, "Force a kernel: scalar, sse2, avx2 or avx512."},
+    {"layout",    'l', "layout",    0, "Grid layout for serial runs: rows, tiles or stream."},
+    {"scratch",   'S', "dir",       0, "Directory for the stream layout's grid files."},
+    {"band",      'B', "rows",      0, "Rows held at a time by the stream layout."},
+    {"stats",     's', "file",      0, "Record tile statistics every iteration, in file.<slave>."},
+    {"counters",  'C', 0,           0, "Count hardware events in each phase of the slaves."},
+    {"async",     'a', 0,           0, "Overlap the termination check with the next iteration."},
+    {"exchange",  'x', "mode",      0, "Boundary row exchange: messages, shared or rma."},
+    {"wire",      'w', "format",    0, "Wire format of sent rows: raw, packed or delta."},
+    {"rebalance", 'r', "iters",     0, "Rebalance rowgroups every iters iterations."},
+    {"imbalance", 'b', "percent",   0, "Imbalance tolerated before rebalancing."},
     {0}
 };
 
 struct arguments {
     uint32_t grid_size;
     uint32_t tile_size;
-    uint32_t threshold;
+    struct thresholds_t thresholds;
     uint32_t max_iters;
     bool verbose;
     bool print;
+    const char* ensemble;
+    uint32_t threads;
+    const char* kernel;
+    enum grid_layout layout;
+    const char* scratch;
+    uint32_t band_rows;
+    const char* stats;
+    bool counters;
+    bool async;
+    uint32_t rebalance;
+    uint32_t imbalance;
+    enum halo_mode exchange;
+    enum wire_format wire;
 };
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
@@ -43,10 +80,57 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
     switch (key) {
         case 'n': args->grid_size = atoi(arg); break;
         case 't': args->tile_size = atoi(arg); break;
-        case 'c': args->threshold = atoi(arg); break;
+        case 'c':
+            if (!thresholds_parse(&args->thresholds, arg)) {
+                argp_error(state, "Invalid threshold list '%s'", arg);
+            }
+            break;
         case 'm': args->max_iters = atoi(arg); break;
         case 'v': args->verbose = true; break;
         case 'p': args->print = true; break;
+        case 'a': args->async = true; break;
+        case 'r': args->rebalance = atoi(arg); break;
+        case 'b': args->imbalance = atoi(arg); break;
+        case 'e': args->ensemble = arg; break;
+        case 'T': args->threads = atoi(arg); break;
+        case 'k': args->kernel = arg; break;
+        case 'S': args->scratch = arg; break;
+        case 'B': args->band_rows = atoi(arg); break;
+        case 's': args->stats = arg; break;
+        case 'C': args->counters = true; break;
+        case 'l':
+            if (strcmp(arg, "tiles") == 0) {
+                args->layout = LAYOUT_TILES;
+            } else if (strcmp(arg, "rows") == 0) {
+                args->layout = LAYOUT_ROWS;
+            } else if (strcmp(arg, "stream") == 0) {
+                args->layout = LAYOUT_STREAM;
+            } else {
+                argp_error(state, "Unknown layout '%s'", arg);
+            }
+            break;
+        case 'x':
+            if (strcmp(arg, "messages") == 0) {
+                args->exchange = HALO_MESSAGES;
+            } else if (strcmp(arg, "shared") == 0) {
+                args->exchange = HALO_SHARED;
+            } else if (strcmp(arg, "rma") == 0) {
+                args->exchange = HALO_RMA;
+            } else {
+                argp_error(state, "Unknown exchange '%s'", arg);
+            }
+            break;
+        case 'w':
+            if (strcmp(arg, "raw") == 0) {
+                args->wire = WIRE_RAW;
+            } else if (strcmp(arg, "packed") == 0) {
+                args->wire = WIRE_PACKED;
+            } else if (strcmp(arg, "delta") == 0) {
+                args->wire = WIRE_DELTA;
+            } else {
+                argp_error(state, "Unknown wire format '%s'", arg);
+            }
+            break;
     }
     return 0;
 }
@@ -58,75 +142,156 @@ void print_and_exit(uint32_t errnum, const char *message) {
     exit(errnum);
 }
 
+// Printed rows go to the master from whoever owns them at the time, so they
+// are never sent as deltas.
+enum wire_format print_format(struct arguments args) {
+    return args.wire == WIRE_RAW ? WIRE_RAW : WIRE_PACKED;
+}
+
 void serial_check(struct grid_t* grid_curr, struct arguments args) {
     fprintf(stderr, "Performing serial check.\n");
 
-    struct grid_t grid_prev;
-    grid_init_copy(&grid_prev, grid_curr);
+    // With the tiled and stream layouts the grid is only used for printing.
+    struct tiled_grid_t tiled_curr;
+    if (args.layout == LAYOUT_TILES) {
+        tiled_init(&tiled_curr, args.grid_size, args.tile_size);
+        tiled_from_grid(&tiled_curr, grid_curr);
+    }
+
+    struct stream_grid_t stream_curr;
+    if (args.layout == LAYOUT_STREAM) {
+        bool created = stream_init(
+            &stream_curr, args.scratch, args.grid_size, args.tile_size,
+            args.band_rows);
+        if (!created) {
+            print_and_exit(1, "Could not create a file for the stream layout");
+        }
+        stream_from_grid(&stream_curr, grid_curr);
+    }
+
+    struct thresholds_t thresholds = args.thresholds;
+    thresholds_reset(&thresholds);
 
     uint32_t iterations = 0;
     bool finished = false;
     while (iterations < args.max_iters && !finished) {
 
-        // RED movement -- red can move right
-        for (uint32_t r = 0; r < args.grid_size; r++) {
-            for (uint32_t c = 0; c < args.grid_size; c++) {
-                if (grid_prev.elements[r][c] != RED) {
-                    continue;
-                }
-
-                uint32_t next = (c+1) % args.grid_size;
-                if (grid_prev.elements[r][next] != WHITE) {
-                    continue;
-                }
-
-                grid_curr->elements[r][c] = WHITE;
-                grid_curr->elements[r][next] = RED;
-            }
+        struct tile_t tile;
+        if (args.layout == LAYOUT_STREAM) {
+            stream_step(&stream_curr, &tile);
+        } else if (args.layout == LAYOUT_TILES) {
+            tiled_step(&tiled_curr);
+            tiled_max_tile(&tiled_curr, &tile);
+        } else {
+            grid_step(grid_curr);
+            grid_max_tile(grid_curr, args.tile_size, &tile);
         }
-
-        grid_copy(&grid_prev, grid_curr);
-
-        // BLUE movement -- blue can move down
-        for (uint32_t r = 0; r < args.grid_size; r++) {
-            for (uint32_t c = 0; c < args.grid_size; c++) {
-                if (grid_prev.elements[r][c] != BLUE) {
-                    continue;
-                }
-
-                uint32_t next = (r+1) % args.grid_size;
-                if (grid_prev.elements[next][c] != WHITE) {
-                    continue;
-                }
-
-                grid_curr->elements[r][c] = WHITE;
-                grid_curr->elements[next][c] = BLUE;
-            }
-        }
-
-        grid_copy(&grid_prev, grid_curr);
-        finished = grid_check_tiles(grid_curr, args.tile_size, args.threshold);
         iterations++;
 
+        finished = thresholds_update(&thresholds, iterations, &tile);
+
         if (args.print) {
+            if (args.layout == LAYOUT_TILES) {
+                tiled_to_grid(&tiled_curr, grid_curr);
+            } else if (args.layout == LAYOUT_STREAM) {
+                stream_to_grid(&stream_curr, grid_curr);
+            }
             grid_print(grid_curr, args.tile_size);
         }
     }
 
+    if (args.layout == LAYOUT_TILES) {
+        tiled_to_grid(&tiled_curr, grid_curr);
+        tiled_free(&tiled_curr);
+    } else if (args.layout == LAYOUT_STREAM) {
+        stream_to_grid(&stream_curr, grid_curr);
+        stream_free(&stream_curr);
+    }
+
     if (!args.print) {
         grid_print(grid_curr, args.tile_size);
     }
 
+    thresholds_print(&thresholds, stderr, "Serial");
+
     if (!finished) {
         fprintf(stderr, "Serial: Hit maximum iterations\n");
     }
 }
 
+// Whether rowgroups are rebalanced after the given iteration. There is no
+// point after the last one.
+bool rebalance_due(struct arguments args, uint32_t iteration) {
+    return args.rebalance > 0
+        && (iteration + 1) % args.rebalance == 0
+        && iteration + 1 < args.max_iters;
+}
+
+// Called by master and every slave with rows, every args.rebalance
+// iterations. Master gathers how long each process spent computing and
+// decides whether rowgroups should move, then shares the new owners. The
+// processes in comm are master and slaves 1..n in order, so a rank in comm is
+// also the process id. Returns true if row_owners changed.
+bool rebalance_owners(
+    struct arguments args,
+    MPI_Comm comm,
+    double compute_time,
+    uint32_t* row_owners
+) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    double times[size];
+    MPI_Gather(
+        &compute_time, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, MPI_MASTER_ID, comm);
+
+    uint32_t rowgroups = args.grid_size / args.tile_size;
+    uint32_t* owners = malloc(rowgroups * sizeof(uint32_t));
+    for (uint32_t g = 0; g < rowgroups; g++) {
+        owners[g] = row_owners[g * args.tile_size];
+    }
+
+    bool changed = false;
+    if (rank == MPI_MASTER_ID) {
+        changed = balance_rowgroups(
+            owners, rowgroups, times, size, args.imbalance / 100.0);
+    }
+
+    MPI_Bcast(&changed, 1, MPI_C_BOOL, MPI_MASTER_ID, comm);
+    if (!changed) {
+        free(owners);
+        return false;
+    }
+
+    MPI_Bcast(owners, rowgroups, MPI_UINT32_T, MPI_MASTER_ID, comm);
+    for (uint32_t g = 0; g < rowgroups; g++) {
+        for (uint32_t j = 0; j < args.tile_size; j++) {
+            row_owners[g * args.tile_size + j] = owners[g];
+        }
+    }
+
+    if (rank == MPI_MASTER_ID && args.verbose) {
+        for (int p = 1; p < size; p++) {
+            uint32_t count = 0;
+            for (uint32_t g = 0; g < rowgroups; g++) {
+                count += owners[g] == (uint32_t)p;
+            }
+            fprintf(
+                stderr, "Rebalanced: process %d took %fs, now owns %u rowgroups\n",
+                p, times[p], count);
+        }
+    }
+
+    free(owners);
+    return true;
+}
+
 void master(struct arguments args, uint32_t id, uint32_t num_procs) {
     assert(id == MPI_MASTER_ID);
 
     // Calculate the owner of each row: row[i] = process_id
-    uint32_t row_owners[args.grid_size];
+    uint32_t* row_owners = malloc(args.grid_size * sizeof(uint32_t));
     for (uint32_t i = 0; i < (args.grid_size / args.tile_size); i++) {
         uint32_t process_id = 1 + i % (num_procs - 1);
         for (uint32_t j = 0; j < args.tile_size; j++) {
@@ -139,58 +304,68 @@ void master(struct arguments args, uint32_t id, uint32_t num_procs) {
         MPI_Send(
             row_owners,
             args.grid_size,
-            MPI_INT,
+            MPI_UINT32_T,
             dest,
             MPI_DEFAULT_TAG,
             MPI_COMM_WORLD);
     }
 
-    // Create and initialize the grid
-    srand(time(NULL));
-    struct grid_t grid_curr;
-    grid_init(&grid_curr, args.grid_size);
+    // Processes beyond the number of rowgroups own nothing and leave, the
+    // rest of us take part in the termination check. Printing needs every
+    // iteration in order, so it never runs ahead. The slaves split before they
+    // take their rows, so this has to come before the rows are sent: once a row
+    // is too big to go eagerly its send waits for them.
+    MPI_Comm sim_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, 0, id, &sim_comm);
+
+    // Master takes no part in the exchange of boundary rows.
+    MPI_Comm halo_comm;
+    MPI_Comm_split(sim_comm, MPI_UNDEFINED, id, &halo_comm);
 
-    struct grid_t grid_backup;
-    grid_init_copy(&grid_backup, &grid_curr);
+    // Create and initialize the grid. Sending only reads it, so the same grid
+    // is kept for the serial check rather than a copy.
+    srand(time(NULL));
+    struct grid_t grid;
+    grid_init(&grid, args.grid_size);
 
     // Send the row data to relevant process
     for (uint32_t r = 0; r < args.grid_size; r++) {
         uint32_t dest = row_owners[r];
 
         // Send row number
-        MPI_Send(&r, 1, MPI_INT, dest, MPI_DEFAULT_TAG, MPI_COMM_WORLD);
+        MPI_Send(&r, 1, MPI_UINT32_T, dest, MPI_DEFAULT_TAG, MPI_COMM_WORLD);
 
         // Send row data
         MPI_Send(
-            grid_curr.elements[r],
+            grid.elements[r],
             args.grid_size,
-            MPI_INT,
+            MPI_CELL_TYPE,
             dest,
             MPI_DEFAULT_TAG,
             MPI_COMM_WORLD);
     }
 
-    size_t ser_size = (
-        sizeof(uint32_t) +
-        sizeof(uint32_t) +
-        sizeof(enum cell_type) * args.grid_size);
+    // Printing receives each row into the same buffer and prints it before
+    // the next, so only a single row is ever held.
+    size_t ser_size = grid_row_encode_size(args.grid_size, print_format(args));
+    void* print_buf = args.print ? malloc(ser_size) : NULL;
+    struct grid_row_t print_row;
+    grid_row_init(&print_row, args.print ? args.grid_size : 0);
 
-    uint32_t tx, ty;
-    enum cell_type color;
-    double ratio;
+    struct termination_t termination;
+    termination_init(
+        &termination, sim_comm, &args.thresholds, args.async && !args.print);
 
     bool done = false;
     for (uint32_t i = 0; i < args.max_iters; i++) {
 
         // Receive the rows from every process and print, acts as a sync.
         if (args.print) {
-            struct grid_row_t rows[args.grid_size];
+            fprintf(stderr, "-----------\n");
 
             for (uint32_t r = 0; r < args.grid_size; r++) {
-                struct grid_row_t row;
-                void* serialized_data = calloc(1, ser_size);
                 MPI_Recv(
-                    serialized_data,
+                    print_buf,
                     ser_size,
                     MPI_BYTE,
                     row_owners[r],
@@ -198,130 +373,153 @@ void master(struct arguments args, uint32_t id, uint32_t num_procs) {
                     MPI_COMM_WORLD,
                     MPI_STATUS_IGNORE);
 
-                grid_row_unserialize(&row, serialized_data);
-                free(serialized_data);
-
-                rows[row.id].id = row.id;
-                rows[row.id].len = row.len;
-                rows[row.id].cells = row.cells;
-            }
-
-            fprintf(stderr, "-----------\n");
-
-            for (uint32_t r = 0; r < args.grid_size; r++) {
+                grid_row_decode(&print_row, print_format(args), print_buf);
 
-                char buf[2048] = {0};
-                grid_row_print(&rows[r], buf);
-                fprintf(stderr, "row %02d: %s\n", rows[r].id, buf);
-                grid_row_free(&rows[r]);
+                fprintf(stderr, "row %02u: ", print_row.id);
+                grid_row_print(&print_row, stderr);
+                fprintf(stderr, "\n");
             }
         }
 
-        size_t sz = (
-            sizeof(bool) +
-            sizeof(uint32_t) +
-            sizeof(uint32_t) +
-            sizeof(enum cell_type) +
-            sizeof(double));
-
-        // From each process, get whether or not that process has found a Tile
-        // that is over the threshold.
-        for (uint32_t p = 1; p < num_procs; p++) {
-            void* data = calloc(1, sz);
-            MPI_Recv(
-                data,
-                sz,
-                MPI_BYTE,
-                p,
-                MPI_DEFAULT_TAG,
-                MPI_COMM_WORLD,
-                MPI_STATUS_IGNORE);
-
-            bool finished = ((bool*)data)[0];
-            size_t cursor = sizeof(finished);
-
-            if (!finished) {
-                continue;
-            }
-
-            // Unpack all the data, inverse of master_finished(...)
-            tx = ((uint32_t*)(data + cursor))[0];
-            cursor += sizeof(tx);
-            ty = ((uint32_t*)(data + cursor))[0];
-            cursor += sizeof(ty);
-            color = ((enum cell_type*)(data + cursor))[0];
-            cursor += sizeof(color);
-            ratio = ((double*)(data + cursor))[0];
-
-            if (!done) {
-                fprintf(
-                    stderr,
-                    "Tile (c=%d, r=%d) has %f%% %s\n",
-                    tx, ty, ratio * 100.0, color == BLUE ? "BLUE" : "RED");
-                done = true;
-            }
-
-        }
+        // Master has no tiles of its own, it only follows the reduction.
+        struct tile_t none;
+        none.tx = 0;
+        none.ty = 0;
+        none.color = WHITE;
+        none.ratio = -1.0;
 
-        for (uint32_t p = 1; p < num_procs; p++) {
-            MPI_Send(&done, 1, MPI_INT, p, MPI_DEFAULT_TAG, MPI_COMM_WORLD);
-        }
+        bool rollback;
+        done = termination_check(&termination, i + 1, &none, &rollback);
 
         if (done) {
             break;
         }
 
+        if (rebalance_due(args, i)) {
+            rebalance_owners(args, termination.comm, 0.0, row_owners);
+        }
+
         if (args.verbose) {
             fprintf(stderr, "Performed %d of %d iterations.\n", i+1, args.max_iters);
         }
     }
 
+    if (!done) {
+        done = termination_finish(&termination, args.max_iters);
+    }
+
+    thresholds_print(&termination.thresholds, stderr, "MPI");
+
+    // Master counts nothing, it only collects what the slaves counted.
+    if (args.counters) {
+        struct perf_t perf;
+        perf_init(&perf, false);
+        perf_report(&perf, termination.comm, 0, stderr);
+        perf_free(&perf);
+    }
+    termination_free(&termination);
+    free(print_buf);
+    grid_row_free(&print_row);
+    free(row_owners);
+
     if (!done) {
         fprintf(stderr, "MPI: Hit maximum iterations\n");
     }
 
-    serial_check(&grid_backup, args);
+    serial_check(&grid, args);
+    grid_free(&grid);
 }
 
 // Comparison for qsort to sort uint32_t in ascending order
 int compare(const void * a, const void * b) {
     uint32_t _a = *(uint32_t*)a;
     uint32_t _b = *(uint32_t*)b;
-    return a - b;
+    return (_a > _b) - (_a < _b);
 }
 
-// A function to quickly that serializes a bunch of data for master. Used as a
-// part of the slave program.
-void master_finished(
-    bool finished,
-    uint32_t tx,
-    uint32_t ty,
-    enum cell_type color,
-    double ratio
+// Comparison for qsort to sort grid_row_t by id in ascending order
+int compare_rows(const void * a, const void * b) {
+    return compare(
+        &((const struct grid_row_t*)a)->id,
+        &((const struct grid_row_t*)b)->id);
+}
+
+// Move rows to their new owners after a rebalance. The rows we keep stay where
+// they are, rows we give away are sent and freed, rows we are given are
+// received, and the array is rebuilt in ascending order.
+void slave_migrate(
+    struct arguments args,
+    uint32_t id,
+    const uint32_t* old_owners,
+    const uint32_t* row_owners,
+    struct grid_row_t** rows_ptr,
+    uint32_t* rows_len_ptr
 ) {
+    struct grid_row_t* rows = *rows_ptr;
+    uint32_t rows_len = *rows_len_ptr;
 
-    // Serialize the data we want to send to master o.0
-    size_t sz = (
-        sizeof(finished) +
-        sizeof(tx) +
-        sizeof(ty) +
-        sizeof(color) +
-        sizeof(ratio));
-    size_t cursor = 0;
-    void* buf = calloc(1, sz);
-    memcpy(buf + cursor, &finished, sizeof(finished));
-    cursor += sizeof(finished);
-    memcpy(buf + cursor, &tx, sizeof(tx));
-    cursor += sizeof(tx);
-    memcpy(buf + cursor, &ty, sizeof(ty));
-    cursor += sizeof(ty);
-    memcpy(buf + cursor, &color, sizeof(color));
-    cursor += sizeof(color);
-    memcpy(buf + cursor, &ratio, sizeof(ratio));
-    cursor += sizeof(ratio);
-
-    // Send the data to master.
-    MPI_Send(buf, sz, MPI_BYTE, MPI_MASTER_ID, MPI_DEFAULT_TAG, MPI_COMM_WORLD);
+    uint32_t kept_len = 0;
+    for (uint32_t r = 0; r < args.grid_size; r++) {
+        if (row_owners[r] == id) {
+            kept_len++;
+        }
+    }
+
+    struct grid_row_t* kept = malloc(kept_len * sizeof(struct grid_row_t));
+    MPI_Request* requests = malloc(rows_len * sizeof(MPI_Request));
+    uint32_t sends = 0;
+    uint32_t k = 0;
+
+    for (uint32_t i = 0; i < rows_len; i++) {
+        uint32_t dest = row_owners[rows[i].id];
+        if (dest == id) {
+            kept[k++] = rows[i];
+            continue;
+        }
+
+        MPI_Isend(
+            rows[i].cells,
+            rows[i].len,
+            MPI_CELL_TYPE,
+            dest,
+            MPI_MIGRATE_TAG,
+            MPI_COMM_WORLD,
+            &requests[sends++]);
+    }
+
+    // Rows from the same process arrive in the order it sent them, ascending.
+    for (uint32_t r = 0; r < args.grid_size; r++) {
+        if (row_owners[r] != id || old_owners[r] == id) {
+            continue;
+        }
+
+        grid_row_init(&kept[k], args.grid_size);
+        kept[k].id = r;
+        MPI_Recv(
+            kept[k].cells,
+            kept[k].len,
+            MPI_CELL_TYPE,
+            old_owners[r],
+            MPI_MIGRATE_TAG,
+            MPI_COMM_WORLD,
+            MPI_STATUS_IGNORE);
+        k++;
+    }
+
+    assert(k == kept_len);
+    MPI_Waitall(sends, requests, MPI_STATUSES_IGNORE);
+    free(requests);
+
+    for (uint32_t i = 0; i < rows_len; i++) {
+        if (row_owners[rows[i].id] != id) {
+            grid_row_free(&rows[i]);
+        }
+    }
+    free(rows);
+
+    qsort(kept, kept_len, sizeof(struct grid_row_t), compare_rows);
+    *rows_ptr = kept;
+    *rows_len_ptr = kept_len;
 }
 
 uint32_t get_rowgroup_id(const struct grid_row_t* row, uint32_t tile_size) {
@@ -329,14 +527,13 @@ uint32_t get_rowgroup_id(const struct grid_row_t* row, uint32_t tile_size) {
 }
 
 void slave(struct arguments args, uint32_t id, uint32_t num_procs) {
-    uint32_t row_owners[args.grid_size];
-    MPI_Status status;
+    uint32_t* row_owners = malloc(args.grid_size * sizeof(uint32_t));
 
     // Get the list of row owners from Master
     MPI_Recv(
         row_owners,
         args.grid_size,
-        MPI_INT,
+        MPI_UINT32_T,
         MPI_MASTER_ID,
         MPI_DEFAULT_TAG,
         MPI_COMM_WORLD,
@@ -350,28 +547,45 @@ void slave(struct arguments args, uint32_t id, uint32_t num_procs) {
         }
     }
 
+    // Only the processes that own rows take part in the termination check.
+    MPI_Comm sim_comm;
+    MPI_Comm_split(
+        MPI_COMM_WORLD, rows_len > 0 ? 0 : MPI_UNDEFINED, id, &sim_comm);
+
     if (rows_len == 0) {
+        free(row_owners);
         return;
     }
 
+    // The boundary rows only pass between slaves.
+    MPI_Comm halo_comm;
+    MPI_Comm_split(sim_comm, 0, id, &halo_comm);
+
+    bool async = args.async && !args.print;
+    struct termination_t termination;
+    termination_init(&termination, sim_comm, &args.thresholds, async);
+
+    struct halo_t halo;
+    halo_init(
+        &halo, halo_comm, args.exchange, args.wire, id, num_procs, args.grid_size,
+        args.tile_size, row_owners);
+
     // Get the row data from Master that we are owning
-    struct grid_row_t rows[rows_len];
+    struct grid_row_t* rows = grid_rows_new(rows_len, args.grid_size);
     for (uint32_t i = 0; i < rows_len; i++) {
-        grid_row_init(&rows[i], args.grid_size);
 
         MPI_Recv(
-            &rows[i].id, 1, MPI_INT,
+            &rows[i].id, 1, MPI_UINT32_T,
             MPI_MASTER_ID, MPI_DEFAULT_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
         MPI_Recv(
-            rows[i].cells, rows[i].len, MPI_INT,
+            rows[i].cells, rows[i].len, MPI_CELL_TYPE,
             MPI_MASTER_ID, MPI_DEFAULT_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
         if (args.verbose) {
-            char buf[2048] = {0};
-            sprintf(buf, "Recv Row %d: ", rows[i].id);
-            grid_row_print(&rows[i], buf);
-            fprintf(stderr, "%d: %s\n", id, buf);
+            fprintf(stderr, "%u: Recv Row %u: ", id, rows[i].id);
+            grid_row_print(&rows[i], stderr);
+            fprintf(stderr, "\n");
         }
     }
 
@@ -379,6 +593,48 @@ void slave(struct arguments args, uint32_t id, uint32_t num_procs) {
         assert(rows[i].id < rows[i+1].id);
     }
 
+    // Both phases update the rows in place. moved carries the blues leaving
+    // one row for the next down a rowgroup. In async mode saved keeps the state
+    // of the previous iteration, until its termination check is known: red is
+    // written into saved instead, and the two swapped, rather than copying.
+    struct grid_row_t moved;
+    grid_row_init(&moved, args.grid_size);
+    struct grid_row_t* saved = grid_rows_new(async ? rows_len : 0, args.grid_size);
+
+    // Printing sends every row of an iteration from the same buffer.
+    size_t ser_size = grid_row_encode_size(args.grid_size, print_format(args));
+    void* print_buf = args.print ? malloc(rows_len * ser_size) : NULL;
+    MPI_Request* print_requests =
+        args.print ? malloc(rows_len * sizeof(MPI_Request)) : NULL;
+
+    // The tile counts of a rowgroup, and the owners before a rebalance.
+    uint32_t tiles_num = args.grid_size / args.tile_size;
+    uint64_t* blue_counts = malloc(tiles_num * sizeof(uint64_t));
+    uint64_t* red_counts = malloc(tiles_num * sizeof(uint64_t));
+    uint32_t* old_owners =
+        args.rebalance > 0 ? malloc(args.grid_size * sizeof(uint32_t)) : NULL;
+
+    // The moves made by each of our rowgroups this iteration, by their index
+    // among ours. There are never more of them than tiles in a row.
+    uint64_t* red_moves = calloc(tiles_num, sizeof(uint64_t));
+    uint64_t* blue_moves = calloc(tiles_num, sizeof(uint64_t));
+
+    struct stats_t stats;
+    if (args.stats != NULL) {
+        size_t path_len = strlen(args.stats) + 16;
+        char path[path_len];
+        snprintf(path, path_len, "%s.%u", args.stats, id);
+        if (!stats_open(&stats, path, args.grid_size, args.tile_size)) {
+            print_and_exit(1, "Could not create the stats file");
+        }
+    }
+
+    // Time spent computing since the last rebalance.
+    double compute_time = 0.0;
+
+    struct perf_t perf;
+    perf_init(&perf, args.counters);
+
     // This is the main action loop. Red -> Blue -> Check
     // Red is easy, we have all the data we need. Blue is harder, it requires
     // communicating with the owner of the next row. I've implemented this using
@@ -387,260 +643,92 @@ void slave(struct arguments args, uint32_t id, uint32_t num_procs) {
     for (uint32_t iterations = 0; iterations < args.max_iters; iterations++) {
 
         // Perform Red
+        double phase_start = MPI_Wtime();
+        perf_begin(&perf);
         for (uint32_t r = 0; r < rows_len; r++) {
-            struct grid_row_t copy;
-            grid_row_copy(&copy, &rows[r]);
-            for (uint32_t c = 0; c < rows[r].len; c++) {
-                if (copy.cells[c] != RED) {
-                    continue;
-                }
-
-                uint32_t next = (c+1) % copy.len;
-                if (copy.cells[next] != WHITE) {
-                    continue;
-                }
-
-                rows[r].cells[c] = WHITE;
-                rows[r].cells[next] = RED;
+            enum cell_type* cells = rows[r].cells;
+            uint32_t len = rows[r].len;
+            if (async) {
+                red_moves[r / args.tile_size] += kernel->red(
+                    cells, saved[r].cells, len, cells[len-1], cells[0]);
+                grid_row_swap(&rows[r], &saved[r]);
+            } else {
+                red_moves[r / args.tile_size] += kernel->red(
+                    cells, cells, len, cells[len-1], cells[0]);
             }
-            grid_row_free(&copy);
         }
+        compute_time += MPI_Wtime() - phase_start;
+        perf_end(&perf, PERF_RED);
 
         // Perform blue...
-
-        // Calculate the IDs of the Row Groups we own.
-        uint32_t rowgroups_len = (uint32_t)(rows_len / args.tile_size);
-        uint32_t rowgroups_owned[rowgroups_len];
-        for (uint32_t r = 0; r < rowgroups_len; r++) {
-            uint32_t row_id = r * args.tile_size;
-            rowgroups_owned[r] = get_rowgroup_id(&rows[row_id], args.tile_size);
-        }
-
-        // Ascending sort; just to make sure.
-        qsort(rowgroups_owned, rowgroups_len, sizeof(int), compare);
-
-
-        // For each rowgroup, send our data to the owner of the row that is
-        // previous to the first row in the rowgroup.
-        // owner(rowgroup[row 0] - 1)
-        MPI_Request requests[rowgroups_len];
-        size_t ser_size = grid_row_serialize_size(args.grid_size);
-        void* sers[rowgroups_len];
-        for (uint32_t i = 0; i < rowgroups_len; i++) {
-            uint32_t rowgroup_id = rowgroups_owned[i];
-            uint32_t row_id = rowgroup_id * args.tile_size;
-            struct grid_row_t* first = NULL;
-
-            // Get the first row back
-            for (uint32_t j = 0; j < rows_len; j++) {
-                if (rows[j].id == row_id) {
-                    first = &rows[j];
-                    break;
-                }
-            }
-
-            int32_t prev_row_id = (first->id == 0 ? args.grid_size - 1 : first->id - 1);
-            uint32_t owner_id = row_owners[prev_row_id];
-
-            sers[i] = grid_row_serialize(first);
-
-            MPI_Isend(
-                sers[i],
-                ser_size,
-                MPI_BYTE,
-                owner_id,
-                MPI_DEFAULT_TAG,
-                MPI_COMM_WORLD,
-                &requests[i]);
+        // Each rowgroup sends a ghost copy of its first row up and of its last
+        // row down, in a single round. With both neighbours in hand a rowgroup
+        // moves the blues entering its first row and leaving its last row
+        // itself, exactly as its neighbours do on their side of the boundary.
+        uint32_t rowgroups_len = rows_len / args.tile_size;
+        perf_begin(&perf);
+        for (uint32_t r = 0; r < rows_len; r += args.tile_size) {
+            uint32_t rowgroup = get_rowgroup_id(&rows[r], args.tile_size);
+            halo_send_up(&halo, rowgroup, rows[r].cells);
+            halo_send_down(&halo, rowgroup, rows[r + args.tile_size - 1].cells);
         }
+        halo_wait(&halo, true, true);
+        perf_end(&perf, PERF_EXCHANGE);
 
-        struct grid_row_t recv_rows[rowgroups_len];
-        struct grid_row_t send_rows[rowgroups_len];
-
-        // Receive the blue rows that we need to perform our blue movement.
-        // These are all the rows below our rowgroups. I.e. the blues in the
-        // last row of each rowgroup will want to move into one of these rows.
-        for (uint32_t i = 0; i < rowgroups_len; i++) {
-            uint32_t rowgroup_id = rowgroups_owned[i];
-            uint32_t row_id = rowgroup_id * args.tile_size + args.tile_size;
-            uint32_t owner_id = row_owners[row_id % args.grid_size];
-
-            // Recv the row from owner_id
-            void* ser = calloc(1, ser_size);
-            MPI_Recv(
-                ser,
-                ser_size,
-                MPI_BYTE,
-                owner_id,
-                MPI_DEFAULT_TAG,
-                MPI_COMM_WORLD,
-                MPI_STATUS_IGNORE
-            );
-            grid_row_unserialize(&recv_rows[i], ser);
-            grid_row_init(&send_rows[i], recv_rows[i].len);
-            send_rows[i].id = recv_rows[i].id;
-            free(ser);
-        }
-
-        // Wait for the asychronous sends to complete then free the memory.
-        for (uint32_t i = 0; i < rowgroups_len; i++) {
-            MPI_Wait(&requests[i], MPI_STATUS_IGNORE);
-            free(sers[i]);
-        }
-
-        // Create a backup of all the rows, we read from these when performing
-        // the blue movement.
-        struct grid_row_t rows_copy[rows_len];
+        // Read from the ghost rows.
+        // Update rows in place, from the top of each rowgroup down.
+        phase_start = MPI_Wtime();
+        perf_begin(&perf);
         for (uint32_t r = 0; r < rows_len; r++) {
-            grid_row_copy(&rows_copy[r], &rows[r]);
-        }
-
-
-        // Now we have all the rows we need to validate blue movement. Therefore
-        // we will perform blue movement.
-        // Read from rows_copy.
-        // Write to rows/recv_rows/send_rows.
-        for (uint32_t r = 0; r < rows_len; r++) {
-            struct grid_row_t* curr = &rows[r];
-            struct grid_row_t* next = NULL;
-            struct grid_row_t* send = NULL;
-
-            uint32_t next_id = (rows[r].id + 1) % args.grid_size;
-
-            if (row_owners[next_id] == id) {
-                for (uint32_t j = 0; j < rows_len; j++) {
-                    if (rows[j].id == next_id) {
-                        next = &rows[j];
-                        break;
-                    }
-                }
-            } else {
-                for (uint32_t j = 0; j < rowgroups_len; j++) {
-                    if (recv_rows[j].id == next_id) {
-                        next = &recv_rows[j];
-                        send = &send_rows[j];
-                        break;
-                    }
-                }
+            uint32_t rowgroup = get_rowgroup_id(&rows[r], args.tile_size);
+            bool first = rows[r].id % args.tile_size == 0;
+            bool last = (rows[r].id + 1) % args.tile_size == 0;
+
+            if (first) {
+                kernel->blue_moved(
+                    halo_from_above(&halo, rowgroup), rows[r].cells,
+                    moved.cells, moved.len);
             }
 
-            assert(next != NULL);
-
-            struct grid_row_t* copy = &rows_copy[r];
+            const enum cell_type* below = last
+                ? halo_from_below(&halo, rowgroup)
+                : rows[r+1].cells;
 
-            for (uint32_t c = 0; c < rows[r].len; c++) {
-                if (copy->cells[c] != BLUE) {
-                    continue;
-                }
-
-                if (next->cells[c] != WHITE) {
-                    continue;
-                }
-
-                if (send != NULL) {
-                    send->cells[c] = BLUE;
-                    curr->cells[c] = WHITE;
-                } else {
-                    next->cells[c] = BLUE;
-                    curr->cells[c] = WHITE;
-                }
-            }
+            blue_moves[r / args.tile_size] +=
+                kernel->blue(rows[r].cells, below, moved.cells, rows[r].len);
         }
+        compute_time += MPI_Wtime() - phase_start;
+        perf_end(&perf, PERF_BLUE);
 
-        // We have moved all the blues. Including moving them into our borrowed
-        // rows. We need to update the original owners about the changes.
-        for (uint32_t i = 0; i < rowgroups_len; i++) {
-            sers[i] = grid_row_serialize(&send_rows[i]);
+        uint32_t print_len = args.print ? rows_len : 0;
+        for (uint32_t i = 0; i < print_len; i++) {
+            grid_row_encode(&rows[i], print_format(args), print_buf + i * ser_size);
             MPI_Isend(
-                sers[i],
-                ser_size,
-                MPI_BYTE,
-                row_owners[send_rows[i].id],
-                MPI_DEFAULT_TAG,
-                MPI_COMM_WORLD,
-                &requests[i]);
-        }
-
-        for (uint32_t i = 0; i < rowgroups_len; i++) {
-            uint32_t rowgroup_id = rowgroups_owned[i];
-
-            // Find row data of the last row of previous rowgroup
-            uint32_t row_id = rowgroup_id * args.tile_size;
-            row_id = (row_id ? row_id - 1 : args.grid_size - 1);
-            uint32_t owner_id = row_owners[row_id];
-
-            struct grid_row_t blue_row;
-
-            void* ser = calloc(1, ser_size);
-            MPI_Recv(
-                ser,
+                print_buf + i * ser_size,
                 ser_size,
                 MPI_BYTE,
-                owner_id,
+                0,
                 MPI_DEFAULT_TAG,
                 MPI_COMM_WORLD,
-                MPI_STATUS_IGNORE
-            );
-            grid_row_unserialize(&blue_row, ser);
-            free(ser);
-
-            struct grid_row_t* local_row = NULL;
-            for (uint32_t i = 0; i < rows_len; i++) {
-                if (rows[i].id == blue_row.id) {
-                    local_row = &rows[i];
-                }
-            }
-            assert(local_row != NULL);
-
-            char blue_row_buf[2048] = {0};
-            grid_row_print(&blue_row, blue_row_buf);
-
-            // blue_row contains the new blue items
-            for (uint32_t c = 0; c < args.grid_size; c++) {
-                if (blue_row.cells[c] == BLUE) {
-                    local_row->cells[c] = BLUE;
-                }
-            }
-        }
-
-        // Free the send buffers when the send actions have completed.
-        for (uint32_t i = 0; i < rowgroups_len; i++) {
-            MPI_Wait(&requests[i], MPI_STATUS_IGNORE);
-            free(sers[i]);
-        }
-
-        // Free the row copies for this run iteration
-        for (uint32_t r = 0; r < rows_len; r++) {
-            grid_row_free(&rows_copy[r]);
-        }
-
-        if (args.print) {
-            for (uint32_t i = 0; i < rows_len; i++) {
-                void* ser = grid_row_serialize(&rows[i]);
-                MPI_Isend(
-                    ser,
-                    ser_size,
-                    MPI_BYTE,
-                    0,
-                    MPI_DEFAULT_TAG,
-                    MPI_COMM_WORLD,
-                    &requests[i]);
-            }
+                &print_requests[i]);
         }
 
-        sleep(0.5);
-
-        double threshold = args.threshold / 100.0;
+        // Find our densest tile. The termination check reduces it with
+        // everyone else's and decides whether we carry on.
+        struct tile_t best;
+        best.tx = 0;
+        best.ty = 0;
+        best.color = WHITE;
+        best.ratio = -1.0;
 
+        phase_start = MPI_Wtime();
+        perf_begin(&perf);
         for (uint32_t i = 0; i < rowgroups_len; i++) {
             // get the tile_size rows and deal with it
             // Get tile_size worth of rows, then check the square, count...
 
             uint32_t row_start = i * args.tile_size;
             uint32_t row_end = row_start + args.tile_size - 1;
-            uint32_t tiles_num = args.grid_size / args.tile_size;
-            uint32_t blue_counts[tiles_num];
-            uint32_t red_counts[tiles_num];
 
             for (uint32_t j = 0; j < tiles_num; j++) {
                 blue_counts[j] = 0;
@@ -649,55 +737,114 @@ void slave(struct arguments args, uint32_t id, uint32_t num_procs) {
 
 
             for (uint32_t r = row_start; r <= row_end; r++) {
-                for (uint32_t c = 0; c < args.grid_size; c++) {
-                    uint32_t t = c / args.tile_size;
-
-                    switch(rows[r].cells[c]) {
-                    case BLUE: blue_counts[t]++; break;
-                    case RED: red_counts[t]++; break;
-                    default: break;
-                    }
-
+                for (uint32_t t = 0; t < tiles_num; t++) {
+                    kernel->count(
+                        rows[r].cells + t * args.tile_size,
+                        args.tile_size,
+                        &blue_counts[t],
+                        &red_counts[t]);
                 }
             }
 
-            uint32_t cells_per_tile = (args.tile_size * args.tile_size);
+            double cells_per_tile = (double)args.tile_size * args.tile_size;
+            uint32_t ty = rows[row_start].id / args.tile_size;
 
             for (uint32_t t = 0; t < tiles_num; t++) {
-                double blue_ratio = (double)(blue_counts[t]) / (double)(cells_per_tile);
-                uint32_t row_id = rows[i * args.tile_size].id;
-                uint32_t ty = row_id / args.tile_size;
-
-                if (blue_ratio >= threshold) {
-                    master_finished(true, t, ty, BLUE, blue_ratio);
-                    return;
+                struct tile_t tile;
+                tile.tx = t;
+                tile.ty = ty;
+
+                tile.color = BLUE;
+                tile.ratio = blue_counts[t] / cells_per_tile;
+                if (tile_better(&tile, &best)) {
+                    best = tile;
                 }
 
-                double red_ratio = (double)(red_counts[t] / cells_per_tile);
-                if (red_ratio >= threshold) {
-                    master_finished(true, t, ty, RED, red_ratio);
-                    return;
+                tile.color = RED;
+                tile.ratio = red_counts[t] / cells_per_tile;
+                if (tile_better(&tile, &best)) {
+                    best = tile;
                 }
             }
 
+            if (args.stats != NULL) {
+                stats_record(
+                    &stats, iterations + 1, ty, blue_counts, red_counts,
+                    red_moves[i], blue_moves[i]);
+            }
+            red_moves[i] = 0;
+            blue_moves[i] = 0;
         }
 
-        master_finished(false, 0, 0, 0, 0);
-
-        bool finished;
-        MPI_Recv(
-            &finished,
-            1,
-            MPI_INT,
-            MPI_MASTER_ID,
-            MPI_DEFAULT_TAG,
-            MPI_COMM_WORLD,
-            MPI_STATUS_IGNORE);
-
+        compute_time += MPI_Wtime() - phase_start;
+        perf_end(&perf, PERF_CHECK);
+
+        // Master has taken the rows for printing by now.
+        MPI_Waitall(print_len, print_requests, MPI_STATUSES_IGNORE);
+
+        // In async mode the check that comes back is for the previous
+        // iteration, and if that finished the run this one never happened,
+        // and neither did the stats recorded for it.
+        bool rollback;
+        bool finished =
+            termination_check(&termination, iterations + 1, &best, &rollback);
+        if (args.stats != NULL) {
+            if (rollback) {
+                stats_discard(&stats);
+            } else {
+                stats_commit(&stats);
+            }
+        }
         if (finished) {
-            return;
+            if (rollback) {
+                for (uint32_t r = 0; r < rows_len; r++) {
+                    grid_row_swap(&rows[r], &saved[r]);
+                }
+            }
+            break;
         }
+
+        // saved is rebuilt by the next Red, so it does not need to migrate.
+        if (rebalance_due(args, iterations)) {
+            memcpy(old_owners, row_owners, args.grid_size * sizeof(uint32_t));
+
+            if (rebalance_owners(args, termination.comm, compute_time, row_owners)) {
+                grid_rows_free(saved, async ? rows_len : 0);
+                slave_migrate(args, id, old_owners, row_owners, &rows, &rows_len);
+                saved = grid_rows_new(async ? rows_len : 0, args.grid_size);
+                if (args.print) {
+                    print_buf = realloc(print_buf, rows_len * ser_size);
+                    print_requests = realloc(
+                        print_requests, rows_len * sizeof(MPI_Request));
+                }
+                halo_update(&halo);
+            }
+            compute_time = 0.0;
+        }
+    }
+
+    termination_finish(&termination, args.max_iters);
+    if (args.counters) {
+        perf_report(&perf, termination.comm, 0, stderr);
     }
+    termination_free(&termination);
+
+    grid_rows_free(rows, rows_len);
+    grid_row_free(&moved);
+    grid_rows_free(saved, async ? rows_len : 0);
+    free(print_buf);
+    free(print_requests);
+    free(blue_counts);
+    free(red_counts);
+    free(old_owners);
+    free(red_moves);
+    free(blue_moves);
+    if (args.stats != NULL) {
+        stats_close(&stats);
+    }
+    perf_free(&perf);
+    halo_free(&halo);
+    free(row_owners);
 }
 
 int main(int argc, char** argv) {
@@ -705,9 +852,16 @@ int main(int argc, char** argv) {
     uint32_t num_procs;
     uint32_t retval;
 
-    if ((retval = MPI_Init(&argc, &argv)) != MPI_SUCCESS) {
+    // Only the main thread talks to MPI, ensemble workers, the stats writer
+    // and the stream reader just compute or do file IO alongside it.
+    int provided;
+    retval = MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    if (retval != MPI_SUCCESS) {
         print_and_exit(retval, "Could not initialize MPI");
     }
+    if (provided < MPI_THREAD_FUNNELED) {
+        print_and_exit(1, "MPI does not support threads alongside its calls");
+    }
 
     if ((retval = MPI_Comm_size(MPI_COMM_WORLD, &num_procs)) != MPI_SUCCESS) {
         print_and_exit(retval, "Error getting number of processes in MPI");
@@ -720,19 +874,72 @@ int main(int argc, char** argv) {
     struct arguments args;
     args.grid_size = 0;
     args.tile_size = 0;
-    args.threshold = 0;
+    args.thresholds.len = 0;
     args.max_iters = 0;
     args.verbose = false;
     args.print = false;
+    args.ensemble = NULL;
+    args.threads = 1;
+    args.kernel = NULL;
+    args.layout = LAYOUT_ROWS;
+    args.scratch = NULL;
+    args.band_rows = 0;
+    args.stats = NULL;
+    args.counters = false;
+    args.async = false;
+    args.rebalance = 0;
+    args.imbalance = 10;
+    args.exchange = HALO_SHARED;
+    args.wire = WIRE_PACKED;
     argp_parse(&argp, argc, argv, 0, 0, &args);
 
+    if (!kernel_init(args.kernel)) {
+        print_and_exit(1, "Kernel is unknown or not supported by this CPU");
+    }
+
+    if (args.verbose && id == MPI_MASTER_ID) {
+        fprintf(stderr, "Using the %s kernel.\n", kernel->name);
+    }
+
     assert(args.grid_size > 0);
     assert(args.tile_size > 0);
-    assert(args.threshold > 0);
     assert(args.max_iters > 0);
+    assert(args.threads > 0);
 
     args.tile_size = (uint32_t)(args.grid_size / args.tile_size);
 
+    if (args.ensemble != NULL) {
+        struct ensemble_t ensemble;
+        if (!ensemble_parse(&ensemble, args.ensemble)) {
+            print_and_exit(1, "Invalid ensemble specification");
+        }
+        ensemble_run(
+            &ensemble,
+            args.grid_size,
+            args.tile_size,
+            args.max_iters,
+            args.threads,
+            args.layout,
+            args.scratch,
+            args.band_rows,
+            id,
+            num_procs);
+        ensemble_free(&ensemble);
+        MPI_Finalize();
+        return 0;
+    }
+
+    assert(args.thresholds.len > 0);
+
+    // A row goes in one message, whose count is an int.
+    if (args.grid_size > INT_MAX) {
+        print_and_exit(1, "Grid size is too big to send a row in one message");
+    }
+    if (args.print
+            && grid_row_encode_size(args.grid_size, print_format(args)) > INT_MAX) {
+        print_and_exit(1, "Grid size is too big to print, try --wire=packed");
+    }
+
     if (id == MPI_MASTER_ID) {
         master(args, id, num_procs);
     } else {
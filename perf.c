@@ -0,0 +1,188 @@
+// syscall is neither C11 nor POSIX.
+#define _GNU_SOURCE
+
+#include "perf.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static const char* PERF_PHASE_NAMES[PERF_PHASES] = {
+    "red", "exchange", "blue", "check",
+};
+
+static const char* PERF_EVENT_NAMES[PERF_EVENTS] = {
+    "task-clock", "cycles", "instructions", "cache-misses", "branch-misses",
+};
+
+#ifdef __linux__
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} PERF_EVENT_CONFIGS[PERF_EVENTS] = {
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int perf_open(enum perf_event event) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_EVENT_CONFIGS[event].type;
+    attr.config = PERF_EVENT_CONFIGS[event].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#else
+static int perf_open(enum perf_event event) {
+    (void)event;
+    return -1;
+}
+#endif
+
+// The count, time enabled and time running of an event, zeros if it cannot
+// be read.
+static void perf_read(int fd, uint64_t values[3]) {
+    if (read(fd, values, 3 * sizeof(uint64_t)) != 3 * sizeof(uint64_t)) {
+        memset(values, 0, 3 * sizeof(uint64_t));
+    }
+}
+
+void perf_init(struct perf_t *self, bool enabled) {
+    memset(self->totals, 0, sizeof(self->totals));
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        self->fds[e] = enabled ? perf_open(e) : -1;
+        memset(self->start[e], 0, sizeof(self->start[e]));
+    }
+}
+
+void perf_begin(struct perf_t *self) {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (self->fds[e] >= 0) {
+            perf_read(self->fds[e], self->start[e]);
+        }
+    }
+}
+
+// When there are more events than hardware counters the kernel takes turns
+// between them, so the count over the phase is scaled up to the time it was
+// enabled during the phase. The scaled totals since opening are no good for
+// this, they need not grow monotonically.
+void perf_end(struct perf_t *self, enum perf_phase phase) {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (self->fds[e] < 0) {
+            continue;
+        }
+
+        uint64_t now[3];
+        perf_read(self->fds[e], now);
+        const uint64_t *start = self->start[e];
+        if (now[0] < start[0] || now[2] <= start[2]) {
+            continue;
+        }
+
+        uint64_t count = now[0] - start[0];
+        uint64_t enabled = now[1] - start[1];
+        uint64_t running = now[2] - start[2];
+        if (enabled != running) {
+            count = (uint64_t)((double)count * enabled / running);
+        }
+        self->totals[phase][e] += count;
+    }
+}
+
+// A count, or n/a when no process counted the event.
+static void perf_print_count(FILE *out, uint64_t value, uint32_t counted) {
+    if (counted == 0) {
+        fprintf(out, " %15s", "n/a");
+    } else {
+        fprintf(out, " %15llu", (unsigned long long)value);
+    }
+}
+
+void perf_report(struct perf_t *self, MPI_Comm comm, int root, FILE *out) {
+    uint64_t totals[PERF_PHASES][PERF_EVENTS];
+    MPI_Reduce(
+        self->totals, totals, PERF_PHASES * PERF_EVENTS, MPI_UINT64_T,
+        MPI_SUM, root, comm);
+
+    // How many processes counted each event.
+    uint32_t counting[PERF_EVENTS];
+    uint32_t counted[PERF_EVENTS];
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        counting[e] = self->fds[e] >= 0;
+    }
+    MPI_Reduce(
+        counting, counted, PERF_EVENTS, MPI_UINT32_T, MPI_SUM, root, comm);
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank != root) {
+        return;
+    }
+
+    uint32_t most = 0;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        most = counted[e] > most ? counted[e] : most;
+    }
+    if (most == 0) {
+        fprintf(out, "Counters: not available, perf_event_open failed.\n");
+        return;
+    }
+
+    fprintf(out, "Counters: summed over %u processes, user space only.\n", most);
+    fprintf(out, "Counters: %-8s %15s %15s %15s %6s %15s %15s\n",
+        "phase", "task-clock ms", "cycles", "instructions", "IPC",
+        "cache-misses", "branch-misses");
+
+    for (int p = 0; p < PERF_PHASES; p++) {
+        const uint64_t *t = totals[p];
+        fprintf(out, "Counters: %-8s", PERF_PHASE_NAMES[p]);
+
+        if (counted[PERF_TASK_CLOCK] == 0) {
+            fprintf(out, " %15s", "n/a");
+        } else {
+            fprintf(out, " %15.3f", t[PERF_TASK_CLOCK] * 1e-6);
+        }
+        perf_print_count(out, t[PERF_CYCLES], counted[PERF_CYCLES]);
+        perf_print_count(out, t[PERF_INSTRUCTIONS], counted[PERF_INSTRUCTIONS]);
+
+        if (counted[PERF_CYCLES] == 0 || counted[PERF_INSTRUCTIONS] == 0
+                || t[PERF_CYCLES] == 0) {
+            fprintf(out, " %6s", "n/a");
+        } else {
+            fprintf(out, " %6.2f", (double)t[PERF_INSTRUCTIONS] / t[PERF_CYCLES]);
+        }
+
+        perf_print_count(out, t[PERF_CACHE_MISSES], counted[PERF_CACHE_MISSES]);
+        perf_print_count(out, t[PERF_BRANCH_MISSES], counted[PERF_BRANCH_MISSES]);
+        fprintf(out, "\n");
+    }
+
+    // Sums over fewer processes would not compare with the rest.
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (counted[e] != 0 && counted[e] < most) {
+            fprintf(out, "Counters: %s only counted on %u of %u processes.\n",
+                PERF_EVENT_NAMES[e], counted[e], most);
+        }
+    }
+}
+
+void perf_free(struct perf_t *self) {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (self->fds[e] >= 0) {
+            close(self->fds[e]);
+        }
+        self->fds[e] = -1;
+    }
+}
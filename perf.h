@@ -0,0 +1,55 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include <mpi.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// The phases of a slave's iteration that are counted separately.
+enum perf_phase {
+    PERF_RED,
+    PERF_EXCHANGE,
+    PERF_BLUE,
+    PERF_CHECK,
+    PERF_PHASES,
+};
+
+enum perf_event {
+    // CPU time, in nanoseconds. A software event, so usually there even where
+    // the hardware ones are not.
+    PERF_TASK_CLOCK,
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENTS,
+};
+
+// Counters read around each phase with Linux perf_event_open, counting the
+// calling thread in user space only. An event that cannot be opened, in a
+// virtual machine, under a strict perf_event_paranoid or on another OS, is
+// left out and reported as such; nothing else changes.
+struct perf_t {
+    // -1 for an event that is not being counted.
+    int fds[PERF_EVENTS];
+    // The count, time enabled and time running of each event at perf_begin.
+    uint64_t start[PERF_EVENTS][3];
+    uint64_t totals[PERF_PHASES][PERF_EVENTS];
+};
+
+// Open the counters when enabled, otherwise count nothing.
+void perf_init(struct perf_t *self, bool enabled);
+
+// Count from here until perf_end into phase.
+void perf_begin(struct perf_t *self);
+void perf_end(struct perf_t *self, enum perf_phase phase);
+
+// Collective over comm. Sum the counts of every process onto root, which
+// prints them to out. Processes count nothing unless they opened counters, so
+// root can take part without counting anything itself.
+void perf_report(struct perf_t *self, MPI_Comm comm, int root, FILE *out);
+
+void perf_free(struct perf_t *self);
+
+#endif
@@ -38,6 +38,35 @@ void grid_row_unserialize(struct grid_row_t* self, void* buf) {
     memcpy(self->cells, cells_ptr, self->len * sizeof(enum cell_type));
 }
 
+// Calculate the byte size of a grid_row_t encoded in format, which is
+// WIRE_RAW or WIRE_PACKED
+size_t grid_row_encode_size(uint32_t grid_size, enum wire_format format) {
+    return sizeof(uint32_t) + sizeof(uint32_t) + wire_max_size(format, grid_size);
+}
+
+// Encode into a buffer of grid_row_encode_size bytes
+void grid_row_encode(
+    const struct grid_row_t* self, enum wire_format format, void* buf
+) {
+    memcpy(buf, &self->id, sizeof(self->id));
+    memcpy(buf + sizeof(self->id), &self->len, sizeof(self->len));
+    wire_encode(
+        format, self->cells, self->len, NULL,
+        buf + sizeof(self->id) + sizeof(self->len));
+}
+
+// Decode the output from grid_row_encode into an initialized row of the same
+// length
+void grid_row_decode(
+    struct grid_row_t* self, enum wire_format format, const void* buf
+) {
+    memcpy(&self->id, buf, sizeof(self->id));
+    memcpy(&self->len, buf + sizeof(self->id), sizeof(self->len));
+    wire_decode(
+        format, buf + sizeof(self->id) + sizeof(self->len), self->len, NULL,
+        self->cells);
+}
+
 // Intialize a grid_row_t
 void grid_row_init(struct grid_row_t *self, uint32_t len) {
     self->id = 0;
@@ -50,18 +79,42 @@ void grid_row_free(struct grid_row_t *self) {
     free(self->cells);
 }
 
-// Useful way to print a grid_row_t to a buffer
-void grid_row_print(struct grid_row_t *self, char* buf) {
+// Allocate an array of len initialized rows of row_len cells
+struct grid_row_t* grid_rows_new(uint32_t len, uint32_t row_len) {
+    struct grid_row_t* rows = malloc(len * sizeof(struct grid_row_t));
+    for (uint32_t i = 0; i < len; i++) {
+        grid_row_init(&rows[i], row_len);
+    }
+    return rows;
+}
+
+// Destroy an array of rows from grid_rows_new
+void grid_rows_free(struct grid_row_t *rows, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        grid_row_free(&rows[i]);
+    }
+    free(rows);
+}
+
+// Useful way to print a grid_row_t, streamed so any length of row fits
+void grid_row_print(const struct grid_row_t *self, FILE* out) {
     for (uint32_t c = 0; c < self->len; c++) {
         switch (self->cells[c]) {
-        case RED:   sprintf(buf + strlen(buf), "> "); break;
-        case BLUE:  sprintf(buf + strlen(buf), "v "); break;
-        case WHITE: sprintf(buf + strlen(buf), "- "); break;
-        default: sprintf(buf + strlen(buf), "%d ", self->cells[c]); break;
+        case RED:   fputs("> ", out); break;
+        case BLUE:  fputs("v ", out); break;
+        case WHITE: fputs("- ", out); break;
+        default: fprintf(out, "%d ", self->cells[c]); break;
         }
     }
 }
 
+// Swap the cells of two rows of the same length, keeping their ids
+void grid_row_swap(struct grid_row_t *a, struct grid_row_t *b) {
+    enum cell_type* cells = a->cells;
+    a->cells = b->cells;
+    b->cells = cells;
+}
+
 // Copy the grid_row_t into a new grid_row_t
 void grid_row_copy(struct grid_row_t *self, const struct grid_row_t *copy) {
     grid_row_init(self, copy->len);
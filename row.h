@@ -1,7 +1,10 @@
 #ifndef _ROW_H_
 #define _ROW_H_
 
+#include <stdio.h>
+
 #include "grid.h"
+#include "wire.h"
 
 struct grid_row_t {
     uint32_t id;
@@ -18,14 +21,36 @@ void* grid_row_serialize(struct grid_row_t* self);
 // Unserialize the output from grid_row_serialize
 void grid_row_unserialize(struct grid_row_t* self, void* buf);
 
+// Calculate the byte size of a grid_row_t encoded in format, which is
+// WIRE_RAW or WIRE_PACKED
+size_t grid_row_encode_size(uint32_t grid_size, enum wire_format format);
+
+// Encode into a buffer of grid_row_encode_size bytes
+void grid_row_encode(
+    const struct grid_row_t* self, enum wire_format format, void* buf);
+
+// Decode the output from grid_row_encode into an initialized row of the same
+// length
+void grid_row_decode(
+    struct grid_row_t* self, enum wire_format format, const void* buf);
+
 // Intialize a grid_row_t
 void grid_row_init(struct grid_row_t *self, uint32_t len);
 
 // Destroy a grid_row_t
 void grid_row_free(struct grid_row_t *self);
 
-// Useful way to print a grid_row_t to a buffer
-void grid_row_print(struct grid_row_t *self, char* buf);
+// Allocate an array of len initialized rows of row_len cells
+struct grid_row_t* grid_rows_new(uint32_t len, uint32_t row_len);
+
+// Destroy an array of rows from grid_rows_new
+void grid_rows_free(struct grid_row_t *rows, uint32_t len);
+
+// Useful way to print a grid_row_t, streamed so any length of row fits
+void grid_row_print(const struct grid_row_t *self, FILE* out);
+
+// Swap the cells of two rows of the same length, keeping their ids
+void grid_row_swap(struct grid_row_t *a, struct grid_row_t *b);
 
 // Copy the grid_row_t into a new grid_row_t
 void grid_row_copy(struct grid_row_t *self, const struct grid_row_t *copy);
@@ -0,0 +1,174 @@
+// nanosleep is POSIX, not C11.
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const uint32_t STATS_VERSION = 1;
+
+// The ring holds at least this much, or a few records when they are bigger.
+static const size_t STATS_RING_BYTES = (size_t)16 << 20;
+static const size_t STATS_RING_RECORDS = 4;
+
+// How long either end sleeps when it has to wait for the other.
+static void stats_pause(void) {
+    struct timespec wait = {0, 100 * 1000};
+    nanosleep(&wait, NULL);
+}
+
+static void* stats_writer(void *arg) {
+    struct stats_t *self = arg;
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+
+    for (;;) {
+        // Read closing before head, so nothing published before closing was
+        // set can be missed.
+        bool closing = atomic_load_explicit(&self->closing, memory_order_acquire);
+        size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+
+        if (head == tail) {
+            if (closing) {
+                break;
+            }
+            stats_pause();
+            continue;
+        }
+
+        // Up to the end of the ring, the rest goes next time round.
+        size_t at = tail & (self->capacity - 1);
+        size_t len = head - tail;
+        if (len > self->capacity - at) {
+            len = self->capacity - at;
+        }
+        fwrite(self->ring + at, 1, len, self->out);
+
+        tail += len;
+        atomic_store_explicit(&self->tail, tail, memory_order_release);
+    }
+
+    return NULL;
+}
+
+bool stats_open(
+    struct stats_t *self,
+    const char *path,
+    uint32_t grid_size,
+    uint32_t tile_size
+) {
+    self->out = fopen(path, "wb");
+    if (self->out == NULL) {
+        return false;
+    }
+
+    struct stats_file_t header;
+    memcpy(header.magic, "RBST", 4);
+    header.version = STATS_VERSION;
+    header.grid_size = grid_size;
+    header.tile_size = tile_size;
+    fwrite(&header, sizeof(header), 1, self->out);
+
+    self->tile_size = tile_size;
+    self->tiles = grid_size / tile_size;
+    self->record_size =
+        sizeof(struct stats_record_t) + 2 * self->tiles * sizeof(float);
+    self->record = malloc(self->record_size);
+
+    // A power of two, so positions wrap with a mask.
+    size_t capacity = 1;
+    while (capacity < STATS_RING_BYTES
+        || capacity < STATS_RING_RECORDS * self->record_size) {
+        capacity *= 2;
+    }
+    self->capacity = capacity;
+    self->ring = malloc(capacity);
+
+    self->held = NULL;
+    self->held_len = 0;
+    self->held_capacity = 0;
+
+    atomic_init(&self->head, 0);
+    atomic_init(&self->tail, 0);
+    atomic_init(&self->closing, false);
+    pthread_create(&self->writer, NULL, stats_writer, self);
+    return true;
+}
+
+// Copy len bytes into the ring and publish them.
+static void stats_push(struct stats_t *self, const void *data, size_t len) {
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    while (head + len
+        - atomic_load_explicit(&self->tail, memory_order_acquire)
+        > self->capacity) {
+        stats_pause();
+    }
+
+    size_t at = head & (self->capacity - 1);
+    size_t first = len < self->capacity - at ? len : self->capacity - at;
+    memcpy(self->ring + at, data, first);
+    memcpy(self->ring, (const uint8_t*)data + first, len - first);
+
+    atomic_store_explicit(&self->head, head + len, memory_order_release);
+}
+
+void stats_record(
+    struct stats_t *self,
+    uint32_t iteration,
+    uint32_t ty,
+    const uint64_t *blue_counts,
+    const uint64_t *red_counts,
+    uint64_t red_moves,
+    uint64_t blue_moves
+) {
+    double cells_per_tile = (double)self->tile_size * self->tile_size;
+    float *densities =
+        (float*)(self->record + sizeof(struct stats_record_t));
+
+    uint64_t coloured = 0;
+    for (uint32_t tx = 0; tx < self->tiles; tx++) {
+        densities[2 * tx] = red_counts[tx] / cells_per_tile;
+        densities[2 * tx + 1] = blue_counts[tx] / cells_per_tile;
+        coloured += red_counts[tx] + blue_counts[tx];
+    }
+
+    struct stats_record_t record;
+    record.iteration = iteration;
+    record.ty = ty;
+    record.red_moves = red_moves;
+    record.blue_moves = blue_moves;
+    record.jam = coloured > 0
+        ? 1.0 - (double)(red_moves + blue_moves) / coloured
+        : 0.0;
+    record.tiles = self->tiles;
+    memcpy(self->record, &record, sizeof(record));
+
+    if (self->held_len + self->record_size > self->held_capacity) {
+        self->held_capacity = 2 * self->held_capacity + self->record_size;
+        self->held = realloc(self->held, self->held_capacity);
+    }
+    memcpy(self->held + self->held_len, self->record, self->record_size);
+    self->held_len += self->record_size;
+}
+
+// A record at a time, as the ring may hold no more than a few.
+void stats_commit(struct stats_t *self) {
+    for (size_t at = 0; at < self->held_len; at += self->record_size) {
+        stats_push(self, self->held + at, self->record_size);
+    }
+    self->held_len = 0;
+}
+
+void stats_discard(struct stats_t *self) {
+    self->held_len = 0;
+}
+
+void stats_close(struct stats_t *self) {
+    atomic_store_explicit(&self->closing, true, memory_order_release);
+    pthread_join(self->writer, NULL);
+    fclose(self->out);
+    free(self->ring);
+    free(self->record);
+    free(self->held);
+}
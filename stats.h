@@ -0,0 +1,92 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// A binary time series of what every rowgroup did in every iteration.
+//
+// The file starts with a stats_file_t. Then comes one record per rowgroup
+// per iteration: a stats_record_t followed by tiles pairs of floats, the RED
+// and then BLUE density of each tile in the rowgroup, left to right. All
+// fields are in the byte order of the machine that wrote them.
+//
+// Records are copied into a ring buffer and a writer thread drains it to the
+// file, so the thread computing never waits on the disk. There is one
+// producer and one consumer, and each only ever moves its own end of the
+// ring, so neither takes a lock. The producer only waits if the writer falls
+// a whole ring behind.
+//
+// Records are held back until stats_commit, so that the records of an
+// iteration that turns out never to have happened can be dropped instead.
+struct stats_file_t {
+    char magic[4];
+    uint32_t version;
+    uint32_t grid_size;
+    uint32_t tile_size;
+};
+
+struct stats_record_t {
+    uint32_t iteration;
+    // The row of tiles, in tiles from the top.
+    uint32_t ty;
+    // The cells that moved in the red and in the blue phase.
+    uint64_t red_moves;
+    uint64_t blue_moves;
+    // The fraction of RED and BLUE cells that could not move.
+    float jam;
+    uint32_t tiles;
+};
+
+struct stats_t {
+    FILE* out;
+    uint32_t tile_size;
+    uint32_t tiles;
+
+    uint8_t* ring;
+    size_t capacity;
+    // Bytes ever written by the producer and by the writer thread, the ring
+    // holds head - tail of them.
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_bool closing;
+    pthread_t writer;
+
+    // One record, built here before being copied into the ring.
+    uint8_t* record;
+    size_t record_size;
+
+    // The records held back since the last commit or discard.
+    uint8_t* held;
+    size_t held_len;
+    size_t held_capacity;
+};
+
+// Create path and start the writer thread. Returns false if path could not be
+// created.
+bool stats_open(
+    struct stats_t *self, const char *path, uint32_t grid_size, uint32_t tile_size);
+
+// Record a rowgroup after an iteration from its tile counts, as counted by
+// kernel->count, and the moves made by its rows. Held until stats_commit.
+void stats_record(
+    struct stats_t *self,
+    uint32_t iteration,
+    uint32_t ty,
+    const uint64_t *blue_counts,
+    const uint64_t *red_counts,
+    uint64_t red_moves,
+    uint64_t blue_moves);
+
+// Write out the records held, or drop them.
+void stats_commit(struct stats_t *self);
+void stats_discard(struct stats_t *self);
+
+// Wait for the writer to drain the ring, and close the file.
+void stats_close(struct stats_t *self);
+
+#endif
@@ -0,0 +1,305 @@
+// pread, pwrite and mkstemp are POSIX, not C11.
+#define _POSIX_C_SOURCE 200809L
+
+#include "stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "kernel.h"
+
+// Bytes per band when the caller leaves it to us.
+static const size_t STREAM_BAND_BYTES = (size_t)64 << 20;
+
+static size_t stream_row_bytes(const struct stream_grid_t *self) {
+    return (size_t)self->size * sizeof(enum cell_type);
+}
+
+static off_t stream_offset(const struct stream_grid_t *self, uint32_t row) {
+    return (off_t)row * stream_row_bytes(self);
+}
+
+// A run out of disk cannot carry on, there is nowhere else for the grid.
+static void stream_fail(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+// Read or write len rows from row, pread and pwrite may stop short.
+static void stream_read(
+    const struct stream_grid_t *self,
+    enum cell_type *cells,
+    uint32_t row,
+    uint32_t len
+) {
+    char *buf = (char*)cells;
+    size_t left = len * stream_row_bytes(self);
+    off_t offset = stream_offset(self, row);
+    while (left > 0) {
+        ssize_t n = pread(self->fd, buf, left, offset);
+        if (n <= 0) {
+            stream_fail("stream read");
+        }
+        buf += n;
+        left -= n;
+        offset += n;
+    }
+}
+
+static void stream_write(
+    const struct stream_grid_t *self,
+    const enum cell_type *cells,
+    uint32_t row,
+    uint32_t len
+) {
+    const char *buf = (const char*)cells;
+    size_t left = len * stream_row_bytes(self);
+    off_t offset = stream_offset(self, row);
+    while (left > 0) {
+        ssize_t n = pwrite(self->fd, buf, left, offset);
+        if (n < 0) {
+            stream_fail("stream write");
+        }
+        buf += n;
+        left -= n;
+        offset += n;
+    }
+}
+
+static void* stream_reader(void *arg) {
+    struct stream_grid_t *self = arg;
+    stream_read(self, self->read_buf, self->read_start, self->read_len);
+    return NULL;
+}
+
+// Start reading a band in the background. Only one band is ever in flight.
+static void stream_prefetch(
+    struct stream_grid_t *self,
+    enum cell_type *cells,
+    uint32_t row,
+    uint32_t len
+) {
+    self->read_buf = cells;
+    self->read_start = row;
+    self->read_len = len;
+    pthread_create(&self->reader, NULL, stream_reader, self);
+}
+
+// Wait for the band being read to arrive.
+static void stream_prefetch_wait(struct stream_grid_t *self) {
+    pthread_join(self->reader, NULL);
+}
+
+bool stream_init(
+    struct stream_grid_t *self,
+    const char *dir,
+    uint32_t size,
+    uint32_t tile_size,
+    uint32_t band_rows
+) {
+    if (dir == NULL) {
+        dir = getenv("TMPDIR");
+    }
+    if (dir == NULL) {
+        dir = "/tmp";
+    }
+
+    size_t path_len = strlen(dir) + sizeof("/redblue-XXXXXX");
+    char path[path_len];
+    snprintf(path, path_len, "%s/redblue-XXXXXX", dir);
+    self->fd = mkstemp(path);
+    if (self->fd < 0) {
+        return false;
+    }
+    unlink(path);
+
+    self->size = size;
+    self->tile_size = tile_size;
+
+    if (band_rows == 0) {
+        band_rows = STREAM_BAND_BYTES / stream_row_bytes(self);
+    }
+    if (band_rows == 0) {
+        band_rows = 1;
+    }
+    if (band_rows > size) {
+        band_rows = size;
+    }
+    self->band_rows = band_rows;
+
+    size_t band_bytes = band_rows * stream_row_bytes(self);
+    self->bands[0] = malloc(band_bytes);
+    self->bands[1] = malloc(band_bytes);
+    self->pending = malloc(stream_row_bytes(self));
+    self->first = malloc(stream_row_bytes(self));
+    self->moved = malloc(stream_row_bytes(self));
+
+    uint32_t tiles = size / tile_size;
+    self->blue_counts = malloc(tiles * sizeof(uint64_t));
+    self->red_counts = malloc(tiles * sizeof(uint64_t));
+    return true;
+}
+
+void stream_free(struct stream_grid_t *self) {
+    close(self->fd);
+    free(self->bands[0]);
+    free(self->bands[1]);
+    free(self->pending);
+    free(self->first);
+    free(self->moved);
+    free(self->blue_counts);
+    free(self->red_counts);
+    self->fd = -1;
+}
+
+void stream_fill_random(
+    struct stream_grid_t *self,
+    double red,
+    double blue,
+    uint64_t seed
+) {
+    uint64_t state = seed;
+    enum cell_type *band = self->bands[0];
+    for (uint32_t start = 0; start < self->size; start += self->band_rows) {
+        uint32_t len = self->size - start < self->band_rows
+            ? self->size - start
+            : self->band_rows;
+        for (uint32_t i = 0; i < len; i++) {
+            grid_fill_random_row(
+                band + (size_t)i * self->size, self->size, red, blue, &state);
+        }
+        stream_write(self, band, start, len);
+    }
+}
+
+void stream_from_grid(struct stream_grid_t *self, const struct grid_t *grid) {
+    for (uint32_t r = 0; r < self->size; r++) {
+        stream_write(self, grid->elements[r], r, 1);
+    }
+}
+
+void stream_to_grid(struct stream_grid_t *self, struct grid_t *grid) {
+    for (uint32_t r = 0; r < self->size; r++) {
+        stream_read(self, grid->elements[r], r, 1);
+    }
+}
+
+// A row has been finished and written, add it to the counts of its rowgroup
+// and, once that is complete, weigh up its tiles.
+static void stream_count(
+    struct stream_grid_t *self,
+    const enum cell_type *cells,
+    uint32_t row,
+    struct tile_t *out
+) {
+    uint32_t ts = self->tile_size;
+    uint32_t tiles = self->size / ts;
+
+    if (row % ts == 0) {
+        memset(self->blue_counts, 0, tiles * sizeof(uint64_t));
+        memset(self->red_counts, 0, tiles * sizeof(uint64_t));
+    }
+
+    for (uint32_t tx = 0; tx < tiles; tx++) {
+        kernel->count(
+            cells + (size_t)tx * ts, ts,
+            &self->blue_counts[tx], &self->red_counts[tx]);
+    }
+
+    if ((row + 1) % ts != 0) {
+        return;
+    }
+
+    double cells_per_tile = (double)ts * ts;
+    for (uint32_t tx = 0; tx < tiles; tx++) {
+        struct tile_t tile;
+        tile.tx = tx;
+        tile.ty = row / ts;
+
+        tile.color = BLUE;
+        tile.ratio = self->blue_counts[tx] / cells_per_tile;
+        if (tile_better(&tile, out)) {
+            *out = tile;
+        }
+
+        tile.color = RED;
+        tile.ratio = self->red_counts[tx] / cells_per_tile;
+        if (tile_better(&tile, out)) {
+            *out = tile;
+        }
+    }
+}
+
+void stream_step(struct stream_grid_t *self, struct tile_t *out) {
+    uint32_t size = self->size;
+    uint32_t band_rows = self->band_rows;
+    uint32_t bands = (size + band_rows - 1) / band_rows;
+
+    out->tx = 0;
+    out->ty = 0;
+    out->color = WHITE;
+    out->ratio = -1.0;
+
+    // The blues leaving the last row for row 0 need the last row after red.
+    // It is red again, the same way, when its band comes round.
+    stream_read(self, self->pending, size - 1, 1);
+    kernel->red(
+        self->pending, self->pending, size,
+        self->pending[size-1], self->pending[0]);
+
+    stream_prefetch(self, self->bands[0], 0, band_rows);
+
+    for (uint32_t b = 0; b < bands; b++) {
+        stream_prefetch_wait(self);
+
+        uint32_t start = b * band_rows;
+        uint32_t len = size - start < band_rows ? size - start : band_rows;
+        enum cell_type *band = self->bands[b % 2];
+
+        // The other buffer was written out in the last round, so the next
+        // band can be read into it while this one is computed.
+        if (b + 1 < bands) {
+            uint32_t next = start + len;
+            uint32_t next_len = size - next < band_rows ? size - next : band_rows;
+            stream_prefetch(self, self->bands[(b + 1) % 2], next, next_len);
+        }
+
+        // RED movement -- rows are independent, as in grid_step.
+        for (uint32_t i = 0; i < len; i++) {
+            enum cell_type *row = band + (size_t)i * size;
+            kernel->red(row, row, size, row[size-1], row[0]);
+        }
+
+        // BLUE movement -- the row held over from the band above can finish
+        // now that the row below it has moved its reds.
+        if (b == 0) {
+            memcpy(self->first, band, size * sizeof(enum cell_type));
+            kernel->blue_moved(self->pending, band, self->moved, size);
+        } else {
+            kernel->blue(self->pending, band, self->moved, size);
+            stream_write(self, self->pending, start - 1, 1);
+            stream_count(self, self->pending, start - 1, out);
+        }
+
+        for (uint32_t i = 0; i + 1 < len; i++) {
+            enum cell_type *row = band + (size_t)i * size;
+            kernel->blue(row, row + size, self->moved, size);
+        }
+
+        // All but the last row are done.
+        stream_write(self, band, start, len - 1);
+        for (uint32_t i = 0; i + 1 < len; i++) {
+            stream_count(self, band + (size_t)i * size, start + i, out);
+        }
+        memcpy(
+            self->pending, band + (size_t)(len - 1) * size,
+            size * sizeof(enum cell_type));
+    }
+
+    // The last row moves into row 0 as it was after red.
+    kernel->blue(self->pending, self->first, self->moved, size);
+    stream_write(self, self->pending, size - 1, 1);
+    stream_count(self, self->pending, size - 1, out);
+}
@@ -0,0 +1,71 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "grid.h"
+
+// A grid kept in a file rather than in memory, for boards too big for RAM.
+// Each iteration sweeps down the file a band of rows at a time. Only two
+// bands are held, the one being computed and the next one, which is read in
+// the background meanwhile, along with a few rows carried from one band to
+// the next.
+//
+// The file is created in a directory and unlinked straight away, so it goes
+// when the grid is freed or the process exits.
+struct stream_grid_t {
+    int fd;
+    uint32_t size;
+    uint32_t tile_size;
+    uint32_t band_rows;
+
+    enum cell_type* bands[2];
+
+    // The last row of the band before, waiting for the first row of the next
+    // one to finish its blue phase.
+    enum cell_type* pending;
+    // Row 0 after red, which the last row moves into.
+    enum cell_type* first;
+    // The blues leaving one row for the next, as in grid_step.
+    enum cell_type* moved;
+
+    // The tile counts of the rowgroup being finished.
+    uint64_t* blue_counts;
+    uint64_t* red_counts;
+
+    // The band being read in the background.
+    pthread_t reader;
+    enum cell_type* read_buf;
+    uint32_t read_start;
+    uint32_t read_len;
+};
+
+// Create the file for a size x size grid in dir, or in $TMPDIR or /tmp when
+// dir is NULL. band_rows is the number of rows held per band, 0 picks a
+// band of about 64MB. Returns false if the file could not be created.
+bool stream_init(
+    struct stream_grid_t *self,
+    const char *dir,
+    uint32_t size,
+    uint32_t tile_size,
+    uint32_t band_rows);
+
+void stream_free(struct stream_grid_t *self);
+
+// Fill the grid the same way as grid_fill_random, a band at a time.
+void stream_fill_random(
+    struct stream_grid_t *self, double red, double blue, uint64_t seed);
+
+// Convert to and from an in memory grid of the same size.
+void stream_from_grid(struct stream_grid_t *self, const struct grid_t *grid);
+void stream_to_grid(struct stream_grid_t *self, struct grid_t *grid);
+
+// Perform one iteration, the same as grid_step, and find the densest tile as
+// grid_max_tile does. Tiles are counted as their rows are written out, so the
+// grid is only swept once.
+void stream_step(struct stream_grid_t *self, struct tile_t *out);
+
+#endif
@@ -0,0 +1,93 @@
+#include "termination.h"
+
+// Reducing tiles keeps the densest, see tile_better. Created by the first
+// termination_init and freed by the last termination_free.
+static MPI_Datatype MPI_TILE_TYPE = MPI_DATATYPE_NULL;
+static MPI_Op MPI_TILE_MAX = MPI_OP_NULL;
+static uint32_t MPI_TILE_USERS = 0;
+
+static void tile_max(void* in, void* inout, int* len, MPI_Datatype* type) {
+    (void)type;
+    struct tile_t* a = in;
+    struct tile_t* b = inout;
+    for (int i = 0; i < *len; i++) {
+        if (tile_better(&a[i], &b[i])) {
+            b[i] = a[i];
+        }
+    }
+}
+
+void termination_init(
+    struct termination_t *self,
+    MPI_Comm comm,
+    const struct thresholds_t *thresholds,
+    bool async
+) {
+    if (MPI_TILE_TYPE == MPI_DATATYPE_NULL) {
+        MPI_Type_contiguous(sizeof(struct tile_t), MPI_BYTE, &MPI_TILE_TYPE);
+        MPI_Type_commit(&MPI_TILE_TYPE);
+        MPI_Op_create(tile_max, 1, &MPI_TILE_MAX);
+    }
+    MPI_TILE_USERS++;
+
+    self->comm = comm;
+    self->async = async;
+    self->pending = false;
+    self->request = MPI_REQUEST_NULL;
+    self->thresholds = *thresholds;
+    thresholds_reset(&self->thresholds);
+}
+
+bool termination_check(
+    struct termination_t *self,
+    uint32_t iteration,
+    const struct tile_t *local,
+    bool *rollback
+) {
+    *rollback = false;
+
+    if (!self->async) {
+        self->local = *local;
+        MPI_Allreduce(
+            &self->local, &self->global, 1, MPI_TILE_TYPE, MPI_TILE_MAX,
+            self->comm);
+        return thresholds_update(&self->thresholds, iteration, &self->global);
+    }
+
+    // The previous iteration's result has had a whole iteration to arrive.
+    if (self->pending) {
+        MPI_Wait(&self->request, MPI_STATUS_IGNORE);
+        self->pending = false;
+        if (thresholds_update(&self->thresholds, iteration - 1, &self->global)) {
+            *rollback = true;
+            return true;
+        }
+    }
+
+    // local is the send buffer of the reduction waited on above, so it can
+    // only be overwritten now.
+    self->local = *local;
+    MPI_Iallreduce(
+        &self->local, &self->global, 1, MPI_TILE_TYPE, MPI_TILE_MAX,
+        self->comm, &self->request);
+    self->pending = true;
+    return false;
+}
+
+bool termination_finish(struct termination_t *self, uint32_t max_iters) {
+    if (self->pending) {
+        MPI_Wait(&self->request, MPI_STATUS_IGNORE);
+        self->pending = false;
+        thresholds_update(&self->thresholds, max_iters, &self->global);
+    }
+    return thresholds_done(&self->thresholds);
+}
+
+void termination_free(struct termination_t *self) {
+    MPI_Comm_free(&self->comm);
+
+    if (--MPI_TILE_USERS == 0) {
+        MPI_Op_free(&MPI_TILE_MAX);
+        MPI_Type_free(&MPI_TILE_TYPE);
+    }
+}
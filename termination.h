@@ -0,0 +1,51 @@
+#ifndef _TERMINATION_H_
+#define _TERMINATION_H_
+
+#include <mpi.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "grid.h"
+#include "threshold.h"
+
+// The per-iteration termination check of an MPI run. Every process taking
+// part contributes its densest tile, the densest overall is reduced onto all
+// of them, and each applies it to its own copy of the thresholds so that they
+// all reach the same decision without a round trip through master.
+//
+// In async mode the reduction of an iteration is started non-blocking and only
+// waited on after the next iteration has been computed. When it turns out the
+// run finished, that next iteration was speculative and must be rolled back.
+struct termination_t {
+    MPI_Comm comm;
+    bool async;
+    bool pending;
+    MPI_Request request;
+    struct tile_t local;
+    struct tile_t global;
+    struct thresholds_t thresholds;
+};
+
+// Takes ownership of comm, which must hold exactly the processes taking part.
+void termination_init(
+    struct termination_t *self,
+    MPI_Comm comm,
+    const struct thresholds_t *thresholds,
+    bool async);
+
+// Submit the densest tile of iteration. Returns true once the run is finished;
+// rollback is set when the decision was for the previous iteration and the
+// state of this one has to be discarded.
+bool termination_check(
+    struct termination_t *self,
+    uint32_t iteration,
+    const struct tile_t *local,
+    bool *rollback);
+
+// Complete any outstanding check after the last iteration, max_iters. Returns
+// true when the run finished on it.
+bool termination_finish(struct termination_t *self, uint32_t max_iters);
+
+void termination_free(struct termination_t *self);
+
+#endif
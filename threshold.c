@@ -0,0 +1,109 @@
+#include "threshold.h"
+
+#include <stdlib.h>
+
+// Comparison for qsort to sort uint32_t in ascending order
+static int compare_values(const void *a, const void *b) {
+    uint32_t _a = *(const uint32_t*)a;
+    uint32_t _b = *(const uint32_t*)b;
+    return (_a > _b) - (_a < _b);
+}
+
+bool thresholds_init(
+    struct thresholds_t *self,
+    const uint32_t *values,
+    uint32_t len
+) {
+    if (len == 0 || len > MAX_THRESHOLDS) {
+        return false;
+    }
+
+    uint32_t sorted[len];
+    for (uint32_t i = 0; i < len; i++) {
+        sorted[i] = values[i];
+    }
+    qsort(sorted, len, sizeof(uint32_t), compare_values);
+
+    self->len = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        if (self->len > 0 && self->values[self->len - 1] == sorted[i]) {
+            continue;
+        }
+        self->values[self->len++] = sorted[i];
+    }
+
+    thresholds_reset(self);
+    return true;
+}
+
+bool thresholds_parse(struct thresholds_t *self, const char *list) {
+    uint32_t values[MAX_THRESHOLDS];
+    uint32_t len = 0;
+
+    while (*list) {
+        char *end;
+        long value = strtol(list, &end, 10);
+        if (end == list || value <= 0 || len == MAX_THRESHOLDS) {
+            return false;
+        }
+        values[len++] = (uint32_t)value;
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return false;
+        }
+        list = end;
+    }
+
+    return thresholds_init(self, values, len);
+}
+
+void thresholds_reset(struct thresholds_t *self) {
+    self->crossed = 0;
+    for (uint32_t i = 0; i < self->len; i++) {
+        self->iterations[i] = 0;
+    }
+}
+
+bool thresholds_update(
+    struct thresholds_t *self,
+    uint32_t iteration,
+    const struct tile_t *tile
+) {
+    // Everything below a crossed threshold has been crossed too, so only the
+    // thresholds from self->crossed upwards are still waiting.
+    while (self->crossed < self->len &&
+           tile->ratio >= self->values[self->crossed] / 100.0) {
+        self->iterations[self->crossed] = iteration;
+        self->tiles[self->crossed] = *tile;
+        self->crossed++;
+    }
+
+    return thresholds_done(self);
+}
+
+bool thresholds_done(const struct thresholds_t *self) {
+    return self->crossed == self->len;
+}
+
+void thresholds_print(
+    const struct thresholds_t *self,
+    FILE *out,
+    const char *prefix
+) {
+    for (uint32_t i = 0; i < self->crossed; i++) {
+        const struct tile_t *tile = &self->tiles[i];
+        fprintf(
+            out,
+            "%s: Threshold %d%% crossed at iteration %d, "
+            "Tile (c=%d, r=%d) has %f%% %s\n",
+            prefix,
+            self->values[i],
+            self->iterations[i],
+            tile->tx,
+            tile->ty,
+            tile->ratio * 100.0,
+            tile->color == BLUE ? "BLUE" : "RED");
+    }
+}
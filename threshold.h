@@ -0,0 +1,45 @@
+#ifndef _THRESHOLD_H_
+#define _THRESHOLD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "grid.h"
+
+#define MAX_THRESHOLDS 64
+
+// A sorted list of thresholds, and the first iteration at which each of them
+// was crossed along with the tile that crossed it.
+struct thresholds_t {
+    uint32_t len;
+    uint32_t crossed;
+    uint32_t values[MAX_THRESHOLDS];
+    uint32_t iterations[MAX_THRESHOLDS];
+    struct tile_t tiles[MAX_THRESHOLDS];
+};
+
+// Initialize from a list of percentages, sorted and with duplicates dropped.
+// Returns false when there are none or too many.
+bool thresholds_init(
+    struct thresholds_t *self, const uint32_t *values, uint32_t len);
+
+// Parse a comma separated list of percentages, e.g. "50,75,90".
+bool thresholds_parse(struct thresholds_t *self, const char *list);
+
+// Forget any crossings, keeping the thresholds themselves.
+void thresholds_reset(struct thresholds_t *self);
+
+// Record the densest tile of an iteration. Returns true once the highest
+// threshold has been crossed.
+bool thresholds_update(
+    struct thresholds_t *self, uint32_t iteration, const struct tile_t *tile);
+
+// True once the highest threshold has been crossed.
+bool thresholds_done(const struct thresholds_t *self);
+
+// Print one line per crossed threshold, prefixed with who is reporting.
+void thresholds_print(
+    const struct thresholds_t *self, FILE *out, const char *prefix);
+
+#endif
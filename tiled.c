@@ -0,0 +1,147 @@
+#include "tiled.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel.h"
+
+// Cells per cache line, rows within a block are padded to a multiple of this.
+static const uint32_t TILED_ALIGN = 64 / sizeof(enum cell_type);
+
+// The start of row i of the block at tile (tx, ty).
+static inline enum cell_type* tiled_row(
+    const struct tiled_grid_t *self,
+    uint32_t tx,
+    uint32_t ty,
+    uint32_t i
+) {
+    size_t block = (size_t)ty * self->tiles + tx;
+    return self->cells + block * self->block_cells + (size_t)i * self->stride;
+}
+
+void tiled_init(struct tiled_grid_t *self, uint32_t size, uint32_t tile_size) {
+    self->size = size;
+    self->tile_size = tile_size;
+    self->tiles = size / tile_size;
+    self->stride = (tile_size + TILED_ALIGN - 1) / TILED_ALIGN * TILED_ALIGN;
+    self->block_cells = (size_t)self->stride * tile_size;
+
+    size_t bytes = (size_t)self->tiles * self->tiles * self->block_cells
+        * sizeof(enum cell_type);
+    self->cells = aligned_alloc(64, bytes);
+    memset(self->cells, 0, bytes);
+    self->boundary = malloc(2 * tile_size * sizeof(enum cell_type));
+}
+
+void tiled_free(struct tiled_grid_t *self) {
+    free(self->cells);
+    free(self->boundary);
+    self->cells = NULL;
+    self->boundary = NULL;
+}
+
+void tiled_from_grid(struct tiled_grid_t *self, const struct grid_t *grid) {
+    uint32_t ts = self->tile_size;
+    for (uint32_t r = 0; r < self->size; r++) {
+        for (uint32_t tx = 0; tx < self->tiles; tx++) {
+            memcpy(
+                tiled_row(self, tx, r / ts, r % ts),
+                grid->elements[r] + tx * ts,
+                ts * sizeof(enum cell_type));
+        }
+    }
+}
+
+void tiled_to_grid(const struct tiled_grid_t *self, struct grid_t *grid) {
+    uint32_t ts = self->tile_size;
+    for (uint32_t r = 0; r < self->size; r++) {
+        for (uint32_t tx = 0; tx < self->tiles; tx++) {
+            memcpy(
+                grid->elements[r] + tx * ts,
+                tiled_row(self, tx, r / ts, r % ts),
+                ts * sizeof(enum cell_type));
+        }
+    }
+}
+
+void tiled_max_tile(const struct tiled_grid_t *self, struct tile_t *out) {
+    double cells_per_tile = (double)self->tile_size * self->tile_size;
+
+    out->tx = 0;
+    out->ty = 0;
+    out->color = WHITE;
+    out->ratio = -1.0;
+
+    for (uint32_t ty = 0; ty < self->tiles; ty++) {
+        for (uint32_t tx = 0; tx < self->tiles; tx++) {
+            // The padding is WHITE, so the whole block can be counted at once.
+            uint64_t blue = 0;
+            uint64_t red = 0;
+            kernel->count(
+                tiled_row(self, tx, ty, 0), self->block_cells, &blue, &red);
+
+            struct tile_t tile;
+            tile.tx = tx;
+            tile.ty = ty;
+
+            tile.color = BLUE;
+            tile.ratio = blue / cells_per_tile;
+            if (tile_better(&tile, out)) {
+                *out = tile;
+            }
+
+            tile.color = RED;
+            tile.ratio = red / cells_per_tile;
+            if (tile_better(&tile, out)) {
+                *out = tile;
+            }
+        }
+    }
+}
+
+void tiled_step(struct tiled_grid_t *self) {
+    uint32_t ts = self->tile_size;
+    uint32_t tiles = self->tiles;
+    uint32_t stride = self->stride;
+
+    // RED movement -- red can move right. Each row runs through its blocks
+    // from left to right, so the cell on the left of a block is carried over
+    // from the block before it was updated. The last block wraps around to
+    // the first cell of the row as it was.
+    for (uint32_t ty = 0; ty < tiles; ty++) {
+        for (uint32_t i = 0; i < ts; i++) {
+            enum cell_type wrap = tiled_row(self, 0, ty, i)[0];
+            enum cell_type left = tiled_row(self, tiles - 1, ty, i)[ts - 1];
+
+            for (uint32_t tx = 0; tx < tiles; tx++) {
+                enum cell_type* cells = tiled_row(self, tx, ty, i);
+                enum cell_type right = tx + 1 < tiles
+                    ? tiled_row(self, tx + 1, ty, i)[0]
+                    : wrap;
+                enum cell_type last = cells[ts - 1];
+                kernel->red(cells, cells, ts, left, right);
+                left = last;
+            }
+        }
+    }
+
+    // BLUE movement -- blue can move down. Each column of blocks is worked from
+    // the top, the same way grid_step works the whole grid.
+    enum cell_type* moved = self->boundary;
+    enum cell_type* first = self->boundary + ts;
+    for (uint32_t tx = 0; tx < tiles; tx++) {
+        const enum cell_type* top = tiled_row(self, tx, 0, 0);
+        memcpy(first, top, ts * sizeof(enum cell_type));
+        kernel->blue_moved(tiled_row(self, tx, tiles - 1, ts - 1), top, moved, ts);
+
+        for (uint32_t ty = 0; ty < tiles; ty++) {
+            enum cell_type* cur = tiled_row(self, tx, ty, 0);
+            for (uint32_t i = 0; i < ts; i++, cur += stride) {
+                const enum cell_type* below = i + 1 < ts
+                    ? cur + stride
+                    : ty + 1 < tiles ? tiled_row(self, tx, ty + 1, 0) : first;
+                kernel->blue(cur, below, moved, ts);
+            }
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef _TILED_H_
+#define _TILED_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "grid.h"
+
+// A grid stored tile by tile instead of row by row. Each tile is a contiguous
+// block of tile_size rows, and tiles follow one another in row-major order.
+// Rows within a block are padded out to stride cells so every row starts on a
+// cache line; the padding is always WHITE.
+struct tiled_grid_t {
+    enum cell_type* cells;
+    uint32_t size;
+    uint32_t tile_size;
+    uint32_t tiles;
+    uint32_t stride;
+    size_t block_cells;
+    // Two block rows of working space for tiled_step.
+    enum cell_type* boundary;
+};
+
+// Allocate an all WHITE tiled grid.
+void tiled_init(struct tiled_grid_t *self, uint32_t size, uint32_t tile_size);
+
+void tiled_free(struct tiled_grid_t *self);
+
+// Convert between the two layouts, the grids must be the same size.
+void tiled_from_grid(struct tiled_grid_t *self, const struct grid_t *grid);
+void tiled_to_grid(const struct tiled_grid_t *self, struct grid_t *grid);
+
+// Same as grid_max_tile, but every tile is a single contiguous count.
+void tiled_max_tile(const struct tiled_grid_t *self, struct tile_t *out);
+
+// Same as grid_step. Red runs along each row of blocks and blue down each column
+// of blocks, in place, with only the cells on the edges of a block reading from
+// its neighbours.
+void tiled_step(struct tiled_grid_t *self);
+
+#endif
@@ -0,0 +1,110 @@
+#include "wire.h"
+
+#include <string.h>
+
+#include "kernel.h"
+
+// A delta is made of 32 bit words: the bitmap, one bit per word of the packed
+// row, then the words that changed.
+static size_t wire_words(uint32_t len) {
+    return wire_packed_size(len) / sizeof(uint32_t);
+}
+
+static size_t wire_bitmap_size(uint32_t len) {
+    return (wire_words(len) + 31) / 32 * sizeof(uint32_t);
+}
+
+size_t wire_packed_size(uint32_t len) {
+    return ((size_t)len + 63) / 64 * 16;
+}
+
+size_t wire_max_size(enum wire_format format, uint32_t len) {
+    switch (format) {
+        case WIRE_PACKED: return wire_packed_size(len);
+        case WIRE_DELTA: return wire_bitmap_size(len) + wire_packed_size(len);
+        default: return (size_t)len * sizeof(enum cell_type);
+    }
+}
+
+size_t wire_encode(
+    enum wire_format format,
+    const enum cell_type *cells,
+    uint32_t len,
+    uint8_t *prev,
+    uint8_t *out
+) {
+    if (format == WIRE_RAW) {
+        memcpy(out, cells, (size_t)len * sizeof(enum cell_type));
+        return (size_t)len * sizeof(enum cell_type);
+    }
+
+    if (format == WIRE_PACKED) {
+        kernel->pack(cells, len, out);
+        return wire_packed_size(len);
+    }
+
+    // Pack after the bitmap, then move the changed words down over the packed
+    // row. A word is only ever moved to where one has already been read.
+    size_t bitmap_size = wire_bitmap_size(len);
+    uint8_t *words = out + bitmap_size;
+    kernel->pack(cells, len, words);
+    memset(out, 0, bitmap_size);
+
+    size_t changed = 0;
+    for (size_t w = 0; w < wire_words(len); w++) {
+        uint32_t now, before;
+        memcpy(&now, words + w * 4, 4);
+        memcpy(&before, prev + w * 4, 4);
+        memcpy(prev + w * 4, &now, 4);
+
+        uint32_t diff = now ^ before;
+        if (diff != 0) {
+            uint32_t bits;
+            memcpy(&bits, out + w / 32 * 4, 4);
+            bits |= (uint32_t)1 << (w % 32);
+            memcpy(out + w / 32 * 4, &bits, 4);
+
+            memcpy(words + changed * 4, &diff, 4);
+            changed++;
+        }
+    }
+
+    return bitmap_size + changed * 4;
+}
+
+void wire_decode(
+    enum wire_format format,
+    const uint8_t *in,
+    uint32_t len,
+    uint8_t *prev,
+    enum cell_type *cells
+) {
+    if (format == WIRE_RAW) {
+        memcpy(cells, in, (size_t)len * sizeof(enum cell_type));
+        return;
+    }
+
+    if (format == WIRE_PACKED) {
+        kernel->unpack(in, len, cells);
+        return;
+    }
+
+    const uint8_t *words = in + wire_bitmap_size(len);
+    size_t changed = 0;
+    for (size_t w = 0; w < wire_words(len); w++) {
+        uint32_t bits;
+        memcpy(&bits, in + w / 32 * 4, 4);
+        if ((bits >> (w % 32) & 1) == 0) {
+            continue;
+        }
+
+        uint32_t diff, before;
+        memcpy(&diff, words + changed * 4, 4);
+        memcpy(&before, prev + w * 4, 4);
+        before ^= diff;
+        memcpy(prev + w * 4, &before, 4);
+        changed++;
+    }
+
+    kernel->unpack(prev, len, cells);
+}
@@ -0,0 +1,46 @@
+#ifndef _WIRE_H_
+#define _WIRE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "grid.h"
+
+// How rows are encoded when they are sent between processes.
+enum wire_format {
+    // The cells as they are in memory.
+    WIRE_RAW,
+    // 2 bits a cell, as packed by kernel->pack.
+    WIRE_PACKED,
+    // Only the words of the packed row that changed since the last row sent
+    // on the same link, after a bitmap of which those are.
+    WIRE_DELTA,
+};
+
+// The bytes of a packed row of len cells.
+size_t wire_packed_size(uint32_t len);
+
+// The most bytes a row of len cells can take in format.
+size_t wire_max_size(enum wire_format format, uint32_t len);
+
+// Encode a row into out, which holds wire_max_size bytes, and return the bytes
+// used. For WIRE_DELTA prev is the packed row last sent on this link, or all
+// zeros for the first, and is updated to this row. It is ignored otherwise.
+size_t wire_encode(
+    enum wire_format format,
+    const enum cell_type *cells,
+    uint32_t len,
+    uint8_t *prev,
+    uint8_t *out);
+
+// Decode a row encoded by wire_encode. For WIRE_DELTA prev must be the packed
+// row last received on this link, or all zeros, and is updated as for
+// wire_encode.
+void wire_decode(
+    enum wire_format format,
+    const uint8_t *in,
+    uint32_t len,
+    uint8_t *prev,
+    enum cell_type *cells);
+
+#endif